@@ -0,0 +1,114 @@
+#define _DEFAULT_SOURCE  // MAP_ANONYMOUS is not part of POSIX.1-2008
+
+#include "arena.h"
+
+#include <string.h>
+#include <sys/mman.h>
+
+#define ARENA_ALIGN 16
+
+struct ArenaBlock {
+  struct ArenaBlock* next;  // Next older block.
+  size_t size;              // Size of the whole mapping, header included.
+};
+
+/// Size of a block header, rounded so the memory after it stays aligned.
+#define BLOCK_HEADER_SIZE ((sizeof(struct ArenaBlock) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+static size_t align_up(size_t size) { return (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1); }
+
+/// Maps a new block and links it into the arena.
+/// @return Pointer to the usable memory of the block, NULL on failure.
+static char* map_block(struct Arena* arena, size_t size) {
+  void* mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mapping == MAP_FAILED) return NULL;
+
+  struct ArenaBlock* block = (struct ArenaBlock*)mapping;
+  block->size = size;
+  block->next = arena->blocks;
+  arena->blocks = block;
+  arena->mappings++;
+  return (char*)mapping + BLOCK_HEADER_SIZE;
+}
+
+void arena_init(struct Arena* arena) {
+  arena->blocks = NULL;
+  arena->cursor = NULL;
+  arena->left = 0;
+  arena->mappings = 0;
+  arena->shared = 0;
+}
+
+int arena_init_shared(struct Arena* arena, size_t size) {
+  arena_init(arena);
+  size = align_up(size);
+  if (size <= BLOCK_HEADER_SIZE) return 1;
+
+  void* mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (mapping == MAP_FAILED) return 1;
+
+  struct ArenaBlock* block = (struct ArenaBlock*)mapping;
+  block->size = size;
+  block->next = NULL;
+  arena->blocks = block;
+  arena->mappings = 1;
+  arena->cursor = (char*)mapping + BLOCK_HEADER_SIZE;
+  arena->left = size - BLOCK_HEADER_SIZE;
+  arena->shared = 1;
+  return 0;
+}
+
+void* arena_alloc(struct Arena* arena, size_t size) {
+  size = align_up(size ? size : 1);
+
+  // Mappings made now would not be seen by the other processes, so everything comes from the one there is.
+  if (arena->shared && size > arena->left) return NULL;
+
+  if (size >= ARENA_LARGE_SIZE && !arena->shared) {
+    // The chunk stays current, large blocks are just linked in for release.
+    return map_block(arena, BLOCK_HEADER_SIZE + size);
+  }
+
+  if (size > arena->left) {
+    char* chunk = map_block(arena, ARENA_CHUNK_SIZE);
+    if (!chunk) return NULL;
+    arena->cursor = chunk;
+    arena->left = ARENA_CHUNK_SIZE - BLOCK_HEADER_SIZE;
+  }
+
+  void* memory = arena->cursor;
+  arena->cursor += size;
+  arena->left -= size;
+  return memory;
+}
+
+void arena_release(struct Arena* arena) {
+  struct ArenaBlock* block = arena->blocks;
+  while (block) {
+    struct ArenaBlock* next = block->next;
+    munmap(block, block->size);
+    block = next;
+  }
+  arena_init(arena);
+}
+
+void slab_init(struct Slab* slab, struct Arena* arena, size_t object_size) {
+  slab->arena = arena;
+  slab->object_size = align_up(object_size < sizeof(void*) ? sizeof(void*) : object_size);
+  slab->free_objects = NULL;
+}
+
+void* slab_alloc(struct Slab* slab) {
+  if (!slab->free_objects) return arena_alloc(slab->arena, slab->object_size);
+
+  void* object = slab->free_objects;
+  memcpy(&slab->free_objects, object, sizeof(void*));
+  memset(object, 0, slab->object_size);
+  return object;
+}
+
+void slab_free(struct Slab* slab, void* object) {
+  if (!object) return;
+  memcpy(object, &slab->free_objects, sizeof(void*));
+  slab->free_objects = object;
+}
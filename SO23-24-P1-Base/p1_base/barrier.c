@@ -0,0 +1,35 @@
+#include "barrier.h"
+
+int barrier_init(struct Barrier* barrier, unsigned int count) {
+  if (pthread_mutex_init(&barrier->mutex, NULL) != 0) return 1;
+  if (pthread_cond_init(&barrier->released, NULL) != 0) {
+    pthread_mutex_destroy(&barrier->mutex);
+    return 1;
+  }
+  barrier->count = count;
+  barrier->waiting = 0;
+  barrier->generation = 0;
+  return 0;
+}
+
+void barrier_destroy(struct Barrier* barrier) {
+  pthread_cond_destroy(&barrier->released);
+  pthread_mutex_destroy(&barrier->mutex);
+}
+
+void barrier_wait(struct Barrier* barrier, void (*on_open)(void*), void* arg) {
+  pthread_mutex_lock(&barrier->mutex);
+  unsigned long generation = barrier->generation;
+
+  if (++barrier->waiting == barrier->count) {
+    if (on_open != NULL) on_open(arg);
+    barrier->waiting = 0;
+    barrier->generation++;
+    pthread_cond_broadcast(&barrier->released);
+  } else {
+    // Spurious wakeups leave the generation as it was.
+    while (barrier->generation == generation) pthread_cond_wait(&barrier->released, &barrier->mutex);
+  }
+
+  pthread_mutex_unlock(&barrier->mutex);
+}
@@ -0,0 +1,32 @@
+#ifndef BARRIER_H
+#define BARRIER_H
+
+#include <pthread.h>
+
+// Barrier for a fixed set of threads that can be passed any number of times.
+// Each pass is a generation, so a thread released from one pass can arrive at the next right away.
+struct Barrier {
+  pthread_mutex_t mutex;
+  pthread_cond_t released;
+  unsigned int count;        // Threads that must arrive for the barrier to open.
+  unsigned int waiting;      // Threads arrived in the current generation.
+  unsigned long generation;  // Bumped every time the barrier opens.
+};
+
+/// Initializes a barrier.
+/// @param barrier Barrier to initialize.
+/// @param count Number of threads that must arrive for the barrier to open.
+/// @return 0 if the barrier was initialized successfully, 1 otherwise.
+int barrier_init(struct Barrier* barrier, unsigned int count);
+
+/// Destroys a barrier no thread is waiting on.
+/// @param barrier Barrier to destroy.
+void barrier_destroy(struct Barrier* barrier);
+
+/// Waits until every thread arrived at the barrier.
+/// @param barrier Barrier to wait on.
+/// @param on_open Called by the last thread to arrive, before any is released. May be NULL.
+/// @param arg Argument passed to on_open.
+void barrier_wait(struct Barrier* barrier, void (*on_open)(void*), void* arg);
+
+#endif  // BARRIER_H
@@ -0,0 +1,121 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "constants.h"
+#include "parser.h"
+
+#define DEFAULT_MB 20  // Size of each generated job file.
+
+// Job files of the kind timed, each made of one line written over and over after a header.
+static const struct {
+  const char* name;
+  const char* header;
+  const char* line;
+} inputs[] = {
+    {"WAIT 0 / comments", "", "WAIT 0\n# A comment the parser skips to the end of the line\n"},
+    {"RESERVE-heavy", "CREATE 1 10 10\n", "RESERVE 1 [(1,1) (2,2) (3,3) (4,4) (5,5) (6,6) (7,7) (8,8)]\n"},
+};
+
+/// Returns the current monotonic time in seconds.
+static double now_s() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/// Reads the number of read syscalls made by the process so far.
+/// @return Number of read syscalls, 0 if it could not be read.
+static long read_syscalls() {
+  long count = 0;
+  char line[64];
+  FILE* io = fopen("/proc/self/io", "r");
+  if (!io) return 0;
+  while (fgets(line, sizeof(line), io) != NULL) {
+    if (sscanf(line, "syscr: %ld", &count) == 1) break;
+  }
+  fclose(io);
+  return count;
+}
+
+/// Parses a job file to the end, the way the job runner does without running the commands.
+/// @return Number of commands parsed, -1 if one was invalid.
+static long parse_all(int fd) {
+  unsigned int event_id, delay, thread_id;
+  size_t num_rows, num_cols, xs[MAX_RESERVATION_SIZE], ys[MAX_RESERVATION_SIZE];
+  long commands = 0;
+  while (1) {
+    int failed = 0;
+    switch (get_next(fd)) {
+      case CMD_CREATE:
+        failed = parse_create(fd, &event_id, &num_rows, &num_cols) != 0;
+        break;
+      case CMD_RESERVE:
+        failed = parse_reserve(fd, MAX_RESERVATION_SIZE, &event_id, xs, ys) == 0;
+        break;
+      case CMD_SHOW:
+        failed = parse_show(fd, &event_id) != 0;
+        break;
+      case CMD_WAIT:
+        failed = parse_wait(fd, &delay, &thread_id) == -1;
+        break;
+      case CMD_LIST_EVENTS:
+      case CMD_BARRIER:
+      case CMD_HELP:
+      case CMD_EMPTY:
+        break;
+      case CMD_INVALID:
+        failed = 1;
+        break;
+      case EOC:
+        return commands;
+    }
+    if (failed) return -1;
+    commands++;
+  }
+}
+
+/// Usage: bench/parse [MB]
+/// Generates job files of MB megabytes (DEFAULT_MB by default) and times parsing each, counting its read syscalls.
+int main(int argc, char* argv[]) {
+  size_t megabytes = argc > 1 ? strtoul(argv[1], NULL, 10) : DEFAULT_MB;
+  if (megabytes == 0) {
+    fprintf(stderr, "Usage: %s [MB]\n", argv[0]);
+    return 1;
+  }
+
+  printf("%-20s %10s %10s %12s\n", "job file", "commands", "parse s", "reads");
+
+  for (size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); i++) {
+    FILE* jobs = tmpfile();
+    if (jobs == NULL) {
+      fprintf(stderr, "Failed to create job file\n");
+      return 1;
+    }
+    fputs(inputs[i].header, jobs);
+    for (size_t written = 0; written < megabytes << 20; written += strlen(inputs[i].line)) {
+      fputs(inputs[i].line, jobs);
+    }
+    fflush(jobs);
+    rewind(jobs);
+
+    int fd = fileno(jobs);
+    long reads = read_syscalls();
+    double start = now_s();
+    long commands = parse_all(fd);
+    double parse_s = now_s() - start;
+    reads = read_syscalls() - reads;
+    parser_close(fd);
+    fclose(jobs);
+
+    if (commands < 0) {
+      fprintf(stderr, "Invalid command in %s job file\n", inputs[i].name);
+      return 1;
+    }
+    printf("%-20s %10ld %10.2f %12ld\n", inputs[i].name, commands, parse_s, reads);
+  }
+
+  return 0;
+}
@@ -0,0 +1,114 @@
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "operations.h"
+
+#define EVENT_ID 1
+#define MAX_SIDE 128   // Venues go from 8x8 up to this many rows and columns.
+#define NUM_THREADS 4  // Threads showing the venue at the same time in the concurrent run.
+
+struct Worker {
+  pthread_t thread;
+  int fd;
+  int failures;
+};
+
+/// Returns the current monotonic time in seconds.
+static double now_s() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/// Reads the number of write syscalls made by the process so far.
+/// @return Number of write syscalls, 0 if it could not be read.
+static long write_syscalls() {
+  long count = 0;
+  char line[64];
+  FILE* io = fopen("/proc/self/io", "r");
+  if (!io) return 0;
+  while (fgets(line, sizeof(line), io) != NULL) {
+    if (sscanf(line, "syscw: %ld", &count) == 1) break;
+  }
+  fclose(io);
+  return count;
+}
+
+/// Shows the venue once.
+static void* show_venue(void* arg) {
+  struct Worker* worker = (struct Worker*)arg;
+  worker->failures += ems_show(EVENT_ID, worker->fd);
+  return NULL;
+}
+
+/// Usage: bench/show
+/// Times a SHOW of square venues of growing size, alone and with NUM_THREADS threads showing at once.
+int main() {
+  int fd = open("/dev/null", O_WRONLY);
+  if (fd < 0) {
+    fprintf(stderr, "Failed to open /dev/null\n");
+    return 1;
+  }
+
+  printf("%8s %12s %10s %16s\n", "venue", "show ms", "writes", "concurrent ms");
+
+  for (size_t side = 8; side <= MAX_SIDE; side *= 2) {
+    if (ems_init(0) != 0 || ems_create(EVENT_ID, side, side) != 0) {
+      fprintf(stderr, "Failed to initialize EMS\n");
+      return 1;
+    }
+
+    // Every other seat of the first row reserved, so the map is not all zeros.
+    size_t xs[MAX_SIDE / 2], ys[MAX_SIDE / 2];
+    for (size_t i = 0; i < side / 2; i++) {
+      xs[i] = 1;
+      ys[i] = 2 * i + 1;
+    }
+    if (ems_reserve(EVENT_ID, side / 2, xs, ys) != 0) {
+      fprintf(stderr, "Failed to reserve seats\n");
+      return 1;
+    }
+
+    long writes = write_syscalls();
+    double start = now_s();
+    if (ems_show(EVENT_ID, fd) != 0) {
+      fprintf(stderr, "Failed to show event\n");
+      return 1;
+    }
+    double show_s = now_s() - start;
+    writes = write_syscalls() - writes;
+
+    struct Worker workers[NUM_THREADS];
+    start = now_s();
+    for (size_t i = 0; i < NUM_THREADS; i++) {
+      workers[i].fd = fd;
+      workers[i].failures = 0;
+      if (pthread_create(&workers[i].thread, NULL, show_venue, &workers[i]) != 0) {
+        fprintf(stderr, "Error creating thread\n");
+        return 1;
+      }
+    }
+
+    int failures = 0;
+    for (size_t i = 0; i < NUM_THREADS; i++) {
+      pthread_join(workers[i].thread, NULL);
+      failures += workers[i].failures;
+    }
+    double concurrent_s = now_s() - start;
+
+    if (failures != 0) {
+      fprintf(stderr, "%d shows failed\n", failures);
+      return 1;
+    }
+
+    printf("%4zux%-3zu %12.2f %10ld %16.2f\n", side, side, show_s * 1e3, writes, concurrent_s * 1e3);
+    ems_terminate();
+  }
+
+  close(fd);
+  return 0;
+}
@@ -1,2 +1,7 @@
 #define MAX_RESERVATION_SIZE 256
 #define STATE_ACCESS_DELAY_MS 10
+#define OPTIMISTIC_RESERVE 1  // 1 claims seats with CAS and rolls back on conflict, 0 locks the event
+#define PRECOMPILED_JOBS 1    // 1 parses a whole job file before running it, 0 parses each command as it is claimed
+#define SHARED_STORE 0                       // 1 keeps one event store in shared memory for every job file process
+#define SHARED_STORE_SIZE ((size_t)1 << 32)  // Bytes reserved for the shared store, only backed once touched
+#define REPORT_STATS 0  // 1 has each job file process print its statistics to stderr when done, 0 keeps quiet
@@ -6,6 +6,27 @@
 struct EventList* create_list() {
   struct EventList* list = (struct EventList*)malloc(sizeof(struct EventList));
   if (!list) return NULL;
+  arena_init(&list->arena);
+  slab_init(&list->event_slab, &list->arena, sizeof(struct Event));
+  slab_init(&list->node_slab, &list->arena, sizeof(struct ListNode));
+  list->head = NULL;
+  list->tail = NULL;
+  return list;
+}
+
+struct EventList* create_shared_list(size_t size) {
+  struct Arena arena;
+  if (arena_init_shared(&arena, size)) return NULL;
+
+  // The list lives at the start of its own arena, so every process sees the same one.
+  struct EventList* list = arena_alloc(&arena, sizeof(struct EventList));
+  if (!list) {
+    arena_release(&arena);
+    return NULL;
+  }
+  list->arena = arena;
+  slab_init(&list->event_slab, &list->arena, sizeof(struct Event));
+  slab_init(&list->node_slab, &list->arena, sizeof(struct ListNode));
   list->head = NULL;
   list->tail = NULL;
   return list;
@@ -14,7 +35,7 @@ struct EventList* create_list() {
 int append_to_list(struct EventList* list, struct Event* event) {
   if (!list) return 1;
 
-  struct ListNode* new_node = (struct ListNode*)malloc(sizeof(struct ListNode));
+  struct ListNode* new_node = (struct ListNode*)slab_alloc(&list->node_slab);
   if (!new_node) return 1;
 
   new_node->event = event;
@@ -31,25 +52,55 @@ int append_to_list(struct EventList* list, struct Event* event) {
   return 0;
 }
 
-static void free_event(struct Event* event) {
-  if (!event) return;
+struct Event* create_event(struct EventList* list, unsigned int event_id, size_t num_rows, size_t num_cols) {
+  if (!list) return NULL;
+
+  struct Event* event = slab_alloc(&list->event_slab);
+  if (!event) return NULL;
+
+  // Big venues get a mapping of their own, whose pages are zero-filled by the kernel on first touch.
+  event->data = arena_alloc(&list->arena, num_rows * num_cols * sizeof(atomic_uint));
+  if (!event->data) {
+    slab_free(&list->event_slab, event);
+    return NULL;
+  }
 
-  free(event->data);
-  free(event);
+  pthread_mutexattr_t attr;
+  pthread_mutexattr_init(&attr);
+  if (list->arena.shared) pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+  int failed = pthread_mutex_init(&event->event_mutex, &attr) != 0;
+  pthread_mutexattr_destroy(&attr);
+  if (failed) {
+    slab_free(&list->event_slab, event);
+    return NULL;
+  }
+
+  event->id = event_id;
+  event->rows = num_rows;
+  event->cols = num_cols;
+  atomic_init(&event->reservations, 0);
+  return event;
+}
+
+void discard_event(struct EventList* list, struct Event* event) {
+  if (!list || !event) return;
+
+  pthread_mutex_destroy(&event->event_mutex);
+  // The seats stay in the arena until the list is freed.
+  slab_free(&list->event_slab, event);
 }
 
 void free_list(struct EventList* list) {
   if (!list) return;
 
-  struct ListNode* current = list->head;
-  while (current) {
-    struct ListNode* temp = current;
-    current = current->next;
-
-    free_event(temp->event);
-    free(temp);
+  // Events, nodes and seats all live in the arena and go away together.
+  if (list->arena.shared) {
+    // So does a shared list itself, so its arena is released from a copy.
+    struct Arena arena = list->arena;
+    arena_release(&arena);
+    return;
   }
-
+  arena_release(&list->arena);
   free(list);
 }
 
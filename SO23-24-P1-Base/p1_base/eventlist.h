@@ -2,17 +2,20 @@
 #define EVENT_LIST_H
 
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stddef.h>
 
+#include "arena.h"
+
 struct Event {
-  unsigned int id;            /// Event id
-  unsigned int reservations;  /// Number of reservations for the event.
+  unsigned int id;           /// Event id
+  atomic_uint reservations;  /// Number of reservations for the event.
   pthread_mutex_t event_mutex;
 
   size_t cols;  /// Number of columns.
   size_t rows;  /// Number of rows.
 
-  unsigned int* data;  /// Array of size rows * cols with the reservations for each seat.
+  atomic_uint* data;  /// Array of size rows * cols with the reservations for each seat.
 };
 
 struct ListNode {
@@ -22,23 +25,45 @@ struct ListNode {
 
 // Linked list structure
 struct EventList {
-  struct ListNode* head;  // Head of the list
-  struct ListNode* tail;  // Tail of the list
+  struct ListNode* head;   // Head of the list
+  struct ListNode* tail;   // Tail of the list
+  struct Arena arena;      // Backs the events, nodes and seats of the list
+  struct Slab event_slab;  // Events of the list
+  struct Slab node_slab;   // Nodes of the list
 };
 
 /// Creates a new event list.
 /// @return Newly created event list, NULL on failure
 struct EventList* create_list();
 
+/// Creates a new event list in memory shared with the child processes forked after this call.
+/// @note Every lock of the list is process-shared, and callers must serialize changes with process-shared locks.
+/// @param size Size of the memory reserved for the list, its events and their seats.
+/// @return Newly created event list, NULL on failure
+struct EventList* create_shared_list(size_t size);
+
 /// Appends a new node to the list.
 /// @param list Event list to be modified.
 /// @param data Event to be stored in the new node.
 /// @return 0 if the node was appended successfully, 1 otherwise.
 int append_to_list(struct EventList* list, struct Event* data);
 
-/// Removes a node from the list.
-/// @param list Event list to be modified.
-/// @return 0 if the node was removed successfully, 1 otherwise.
+/// Allocates a new event with every seat free, ready to be appended to the list.
+/// @note Allocations from the same list must be serialized by the caller.
+/// @param list Event list whose arena backs the event.
+/// @param event_id Event id.
+/// @param num_rows Number of rows.
+/// @param num_cols Number of columns.
+/// @return Newly created event, NULL on failure.
+struct Event* create_event(struct EventList* list, unsigned int event_id, size_t num_rows, size_t num_cols);
+
+/// Gives back an event that was never appended to the list.
+/// @param list Event list the event was created from.
+/// @param event Event to be discarded.
+void discard_event(struct EventList* list, struct Event* event);
+
+/// Frees the list with all its events at once.
+/// @param list Event list to be freed.
 void free_list(struct EventList* list);
 
 /// Retrieves an event in the list.
@@ -0,0 +1,95 @@
+#include "jobs.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "constants.h"
+
+/// Appends a job to a job file, growing its array if needed.
+/// @param file Job file to append to.
+/// @return Pointer to the new job, NULL if memory ran out.
+static struct Job *push_job(struct JobFile *file) {
+  if (file->num_jobs == file->jobs_capacity) {
+    size_t capacity = file->jobs_capacity == 0 ? 256 : file->jobs_capacity * 2;
+    struct Job *jobs = realloc(file->jobs, capacity * sizeof(struct Job));
+    if (jobs == NULL) return NULL;
+    file->jobs = jobs;
+    file->jobs_capacity = capacity;
+  }
+
+  struct Job *job = &file->jobs[file->num_jobs++];
+  memset(job, 0, sizeof(struct Job));
+  return job;
+}
+
+/// Makes room for the seats of one more RESERVE in the coordinate arrays of a job file.
+/// @param file Job file to grow.
+/// @return 0 if there is room, 1 if memory ran out.
+static int reserve_seats(struct JobFile *file) {
+  if (file->seats_capacity - file->num_seats >= MAX_RESERVATION_SIZE) return 0;
+
+  size_t capacity = file->seats_capacity == 0 ? 4 * MAX_RESERVATION_SIZE : file->seats_capacity * 2;
+  size_t *xs = realloc(file->xs, capacity * sizeof(size_t));
+  if (xs == NULL) return 1;
+  file->xs = xs;
+  size_t *ys = realloc(file->ys, capacity * sizeof(size_t));
+  if (ys == NULL) return 1;
+  file->ys = ys;
+  file->seats_capacity = capacity;
+  return 0;
+}
+
+int load_jobs(int fd, struct JobFile *file) {
+  memset(file, 0, sizeof(struct JobFile));
+
+  while (1) {
+    enum Command command = get_next(fd);
+    if (command == EOC) return 0;
+    if (command == CMD_EMPTY) continue;
+
+    struct Job *job = push_job(file);
+    if (job == NULL) return 1;
+    job->command = command;
+
+    switch (command) {
+      case CMD_CREATE:
+        if (parse_create(fd, &job->event_id, &job->create.num_rows, &job->create.num_cols) != 0)
+          job->command = CMD_INVALID;
+        break;
+
+      case CMD_RESERVE:
+        if (reserve_seats(file)) return 1;
+        job->reserve.first_seat = file->num_seats;
+        job->reserve.num_seats = parse_reserve(fd, MAX_RESERVATION_SIZE, &job->event_id, file->xs + file->num_seats,
+                                               file->ys + file->num_seats);
+        if (job->reserve.num_seats == 0)
+          job->command = CMD_INVALID;
+        else
+          file->num_seats += job->reserve.num_seats;
+        break;
+
+      case CMD_SHOW:
+        if (parse_show(fd, &job->event_id) != 0) job->command = CMD_INVALID;
+        break;
+
+      case CMD_WAIT:
+        if (parse_wait(fd, &job->wait.delay, &job->wait.thread_id) == -1) job->command = CMD_INVALID;
+        break;
+
+      case CMD_LIST_EVENTS:
+      case CMD_BARRIER:
+      case CMD_HELP:
+      case CMD_INVALID:
+      case CMD_EMPTY:
+      case EOC:
+        break;
+    }
+  }
+}
+
+void free_jobs(struct JobFile *file) {
+  free(file->jobs);
+  free(file->xs);
+  free(file->ys);
+  memset(file, 0, sizeof(struct JobFile));
+}
@@ -0,0 +1,43 @@
+#ifndef EMS_JOBS_H
+#define EMS_JOBS_H
+
+#include <stddef.h>
+
+#include "parser.h"
+
+// A command of a job file, parsed ahead of its execution.
+struct Job {
+  enum Command command;
+  unsigned int event_id;  // Event of a CREATE, RESERVE or SHOW.
+  union {
+    struct {
+      size_t num_rows, num_cols;
+    } create;
+    struct {
+      size_t first_seat, num_seats;  // Range of the seats in the coordinate arrays of the job file.
+    } reserve;
+    struct {
+      unsigned int delay, thread_id;  // A thread_id of 0 delays every thread.
+    } wait;
+  };
+};
+
+// The commands of a whole job file, in file order. Empty lines and comments are dropped.
+struct JobFile {
+  struct Job *jobs;
+  size_t num_jobs, jobs_capacity;
+  size_t *xs, *ys;  // Coordinates of the seats of every RESERVE, one after the other.
+  size_t num_seats, seats_capacity;
+};
+
+/// Parses a whole job file.
+/// @param fd File descriptor to read the job file from.
+/// @param file Job file to fill in. Must be freed with free_jobs, even on failure.
+/// @return 0 if the job file was read successfully, 1 if memory ran out.
+int load_jobs(int fd, struct JobFile *file);
+
+/// Frees the commands of a job file.
+/// @param file Job file to free.
+void free_jobs(struct JobFile *file);
+
+#endif  // EMS_JOBS_H
@@ -9,8 +9,12 @@
 #include <sys/stat.h>
 #include <sys/wait.h>
 #include <pthread.h>
+#include <time.h>
+#include <stdatomic.h>
 
+#include "barrier.h"
 #include "constants.h"
+#include "jobs.h"
 #include "operations.h"
 #include "parser.h"
 
@@ -24,9 +28,114 @@ struct CommandInfo {
 
 pthread_mutex_t mutex_in = PTHREAD_MUTEX_INITIALIZER;
 pthread_mutex_t stop_mutex = PTHREAD_MUTEX_INITIALIZER;
-unsigned int thread_stop = 0;
-unsigned int stop_time = 0;
 int barrier = 0;
+struct Barrier thread_barrier;  // Where every thread waits at a BARRIER, or between segments of job_file.
+
+// Commands of the job file being run, of which the threads claim those before segment_end.
+struct JobFile job_file;
+size_t segment_end;
+atomic_size_t next_job;
+
+static void print_help() {
+  printf(
+      "Available commands:\n"
+      "  CREATE <event_id> <num_rows> <num_columns>\n"
+      "  RESERVE <event_id> [(<x1>,<y1>) (<x2>,<y2>) ...]\n"
+      "  SHOW <event_id>\n"
+      "  LIST\n"
+      "  WAIT <delay_ms> [thread_id]\n"
+      "  BARRIER\n"
+      "  HELP\n");
+}
+
+// Delays queued for a thread by WAITs targeting it, slept through before its next command.
+struct DelayQueue {
+  pthread_mutex_t mutex;
+  atomic_size_t count;  // Read without the mutex, so threads with nothing queued don't take it.
+  size_t head, capacity;
+  unsigned int *delays;  // Ring of capacity delays, the oldest at head.
+};
+
+struct DelayQueue *delay_queues;  // One per thread, indexed by thread id.
+unsigned int num_delay_queues;
+
+/// Creates an empty delay queue for every thread.
+/// @param max_threads Number of threads.
+/// @return 0 if the queues were created successfully, 1 otherwise.
+static int init_delay_queues(unsigned int max_threads) {
+  delay_queues = calloc(max_threads + 1, sizeof(struct DelayQueue));
+  if (delay_queues == NULL)
+    return 1;
+  num_delay_queues = max_threads + 1;
+  for (unsigned int i = 0; i < num_delay_queues; i++)
+    pthread_mutex_init(&delay_queues[i].mutex, NULL);
+  return 0;
+}
+
+/// Frees the delay queues of every thread.
+static void free_delay_queues() {
+  for (unsigned int i = 0; i < num_delay_queues; i++) {
+    pthread_mutex_destroy(&delay_queues[i].mutex);
+    free(delay_queues[i].delays);
+  }
+  free(delay_queues);
+  delay_queues = NULL;
+  num_delay_queues = 0;
+}
+
+/// Queues a delay for a thread, after those already queued for it.
+/// @param thread_id Thread to delay. Threads that don't exist are never delayed.
+/// @param delay Delay in milliseconds.
+static void queue_delay(unsigned int thread_id, unsigned int delay) {
+  if (thread_id == 0 || thread_id >= num_delay_queues)
+    return;
+
+  struct DelayQueue *queue = &delay_queues[thread_id];
+  pthread_mutex_lock(&queue->mutex);
+  size_t count = atomic_load(&queue->count);
+  if (count == queue->capacity) {
+    size_t capacity = queue->capacity == 0 ? 4 : queue->capacity * 2;
+    unsigned int *delays = malloc(capacity * sizeof(unsigned int));
+    if (delays == NULL) {
+      pthread_mutex_unlock(&queue->mutex);
+      fprintf(stderr, "Failed to queue wait for thread %u\n", thread_id);
+      return;
+    }
+    for (size_t i = 0; i < count; i++)
+      delays[i] = queue->delays[(queue->head + i) % queue->capacity];
+    free(queue->delays);
+    queue->delays = delays;
+    queue->head = 0;
+    queue->capacity = capacity;
+  }
+  queue->delays[(queue->head + count) % queue->capacity] = delay;
+  atomic_store(&queue->count, count + 1);
+  pthread_mutex_unlock(&queue->mutex);
+}
+
+/// Sleeps through every delay queued for a thread, holding no lock while sleeping.
+/// @param thread_id Thread calling.
+static void run_queued_delays(unsigned int thread_id) {
+  struct DelayQueue *queue = &delay_queues[thread_id];
+  while (atomic_load(&queue->count) > 0) {
+    pthread_mutex_lock(&queue->mutex);
+    unsigned int delay = queue->delays[queue->head];
+    queue->head = (queue->head + 1) % queue->capacity;
+    atomic_fetch_sub(&queue->count, 1);
+    pthread_mutex_unlock(&queue->mutex);
+
+    printf("Waiting...\n");
+    ems_wait(delay);
+  }
+}
+
+/// Lets threads parse commands again once all of them stopped at a BARRIER.
+static void clear_barrier(void *arg) {
+  (void)arg;
+  pthread_mutex_lock(&stop_mutex);
+  barrier = 0;
+  pthread_mutex_unlock(&stop_mutex);
+}
 
 void *process_command(void *arg) {
   struct CommandInfo *cmd_info = (struct CommandInfo *)arg;
@@ -34,17 +143,14 @@ void *process_command(void *arg) {
   unsigned int thread_id;
   int eof = 0;
   while(!eof){
+    run_queued_delays(cmd_info->thread_id);
     pthread_mutex_lock(&mutex_in);
     pthread_mutex_lock(&stop_mutex);
-    if (thread_stop == cmd_info->thread_id){
-      printf("Waiting...\n");
-      ems_wait(stop_time);
-      thread_stop = 0;
-    }
     if (barrier == 1){
       pthread_mutex_unlock(&stop_mutex);
       pthread_mutex_unlock(&mutex_in);
-      pthread_exit((void*)1);
+      barrier_wait(&thread_barrier, clear_barrier, NULL);
+      continue;
     }
     pthread_mutex_unlock(&stop_mutex);
     switch (get_next(cmd_info->inputFd)) {
@@ -108,10 +214,7 @@ void *process_command(void *arg) {
                   ems_wait(cmd_info->delay);
               }
               else{
-                pthread_mutex_lock(&stop_mutex);
-                thread_stop = thread_id;
-                stop_time = cmd_info->delay;
-                pthread_mutex_unlock(&stop_mutex);
+                queue_delay(thread_id, cmd_info->delay);
               }
               pthread_mutex_unlock(&mutex_in);
           }
@@ -127,15 +230,7 @@ void *process_command(void *arg) {
 
       case CMD_HELP:
           pthread_mutex_unlock(&mutex_in);
-          printf(
-              "Available commands:\n"
-              "  CREATE <event_id> <num_rows> <num_columns>\n"
-              "  RESERVE <event_id> [(<x1>,<y1>) (<x2>,<y2>) ...]\n"
-              "  SHOW <event_id>\n"
-              "  LIST\n"
-              "  WAIT <delay_ms> [thread_id]\n" 
-              "  BARRIER\n"                      
-              "  HELP\n");
+          print_help();
           break;
 
       case CMD_BARRIER:
@@ -153,18 +248,288 @@ void *process_command(void *arg) {
           eof = 1;
     }
   }
-  pthread_exit((void*)0);
   return NULL;
 }
 
+#if PRECOMPILED_JOBS
+/// Tells whether a command must wait for every command before it to finish before running.
+/// @param job Command to check.
+/// @return 1 if it ends a segment, 0 otherwise.
+static int ends_segment(const struct Job *job) {
+  return job->command == CMD_BARRIER || (job->command == CMD_WAIT && job->wait.thread_id == 0 && job->wait.delay > 0);
+}
+
+/// Moves on to the segment of job_file starting at a command.
+/// @param start Index of the first command of the segment.
+static void start_segment(size_t start) {
+  size_t end = start;
+  while (end < job_file.num_jobs && !ends_segment(&job_file.jobs[end]))
+    end++;
+
+  segment_end = end;
+  atomic_store(&next_job, start);
+}
+
+/// Runs the command ending the current segment, if it is a WAIT, and moves on to the next segment.
+/// Called by the last thread to finish the current segment, while the others wait.
+static void next_segment(void *arg) {
+  (void)arg;
+  struct Job *job = &job_file.jobs[segment_end];
+  if (job->command == CMD_WAIT) {
+    printf("Waiting...\n");
+    ems_wait(job->wait.delay);
+  }
+  start_segment(segment_end + 1);
+}
+
+/// Runs the commands of job_file, claiming one at a time and waiting for the other threads at the end of each segment.
+void *process_jobs(void *arg) {
+  struct CommandInfo *cmd_info = (struct CommandInfo *)arg;
+
+  while (1) {
+    run_queued_delays(cmd_info->thread_id);
+
+    size_t index = atomic_fetch_add(&next_job, 1);
+    if (index >= segment_end) {
+      if (segment_end == job_file.num_jobs)
+        break;
+      barrier_wait(&thread_barrier, next_segment, NULL);
+      continue;
+    }
+
+    struct Job *job = &job_file.jobs[index];
+    switch (job->command) {
+      case CMD_CREATE:
+        if (ems_create(job->event_id, job->create.num_rows, job->create.num_cols)) {
+          fprintf(stderr, "Failed to create event\n");
+        }
+        break;
+
+      case CMD_RESERVE:
+        if (ems_reserve(job->event_id, job->reserve.num_seats, job_file.xs + job->reserve.first_seat,
+                        job_file.ys + job->reserve.first_seat)) {
+          fprintf(stderr, "Failed to reserve seats\n");
+        }
+        break;
+
+      case CMD_SHOW:
+        if (ems_show(job->event_id, cmd_info->outputFd)) {
+          fprintf(stderr, "Failed to show event\n");
+        }
+        break;
+
+      case CMD_LIST_EVENTS:
+        if (ems_list_events(cmd_info->outputFd)) {
+          fprintf(stderr, "Failed to list events\n");
+        }
+        break;
+
+      case CMD_WAIT:
+        // Waits of every thread end a segment, so only those of a single thread get here.
+        if (job->wait.delay > 0)
+          queue_delay(job->wait.thread_id, job->wait.delay);
+        break;
+
+      case CMD_INVALID:
+        fprintf(stderr, "Invalid command. See HELP for usage\n");
+        break;
+
+      case CMD_HELP:
+        print_help();
+        break;
+
+      case CMD_BARRIER:
+      case CMD_EMPTY:
+      case EOC:
+        break;
+    }
+  }
+  return NULL;
+}
+
+/// Parses a whole job file, then runs it with a pool of threads claiming its commands with an atomic index.
+/// BARRIERs and WAITs of every thread split the file into segments that run one after the other, with the same
+/// threads waiting for each other at the end of each.
+/// @param inputFd File descriptor of the job file.
+/// @param outputFd File descriptor to write the output of the commands to.
+/// @param max_threads Number of threads to run the commands with.
+/// @return 0 if the job file was run, 1 otherwise.
+static int run_jobs(int inputFd, int outputFd, int max_threads) {
+  if (load_jobs(inputFd, &job_file)) {
+    fprintf(stderr, "Failed to load job file\n");
+    free_jobs(&job_file);
+    return 1;
+  }
+
+  pthread_t thread_array[max_threads + 1];
+  struct CommandInfo cmd_info_array[max_threads + 1];
+
+  start_segment(0);
+  for (int i = 1; i <= max_threads; i++) {
+    cmd_info_array[i].outputFd = outputFd;
+    cmd_info_array[i].thread_id = (unsigned int)i;
+    if (pthread_create(&thread_array[i], NULL, process_jobs, (void *)&cmd_info_array[i]) != 0) {
+      // Threads already started would wait for the missing ones at the first segment end forever.
+      fprintf(stderr, "Error creating thread\n");
+      exit(1);
+    }
+  }
+  for (int i = 1; i <= max_threads; i++)
+    pthread_join(thread_array[i], NULL);
+
+  free_jobs(&job_file);
+  return 0;
+}
+#endif
+
+// A job file of the directory, waiting for or being run by a child process.
+struct JobFileEntry {
+  char name[NAME_MAX + 1];
+  off_t size;
+  pid_t pid;
+  double start_ms;
+};
+
+/// Returns the current monotonic time in milliseconds.
+static double now_ms() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1e3 + (double)ts.tv_nsec / 1e6;
+}
+
+/// Orders job files from the largest to the smallest, so the longest ones start first.
+static int compare_size_desc(const void *a, const void *b) {
+  off_t size_a = ((const struct JobFileEntry *)a)->size, size_b = ((const struct JobFileEntry *)b)->size;
+  return (size_a < size_b) - (size_a > size_b);
+}
+
+/// Runs a job file, writing its output next to it with the extension replaced by .out. Runs in a child process.
+/// @param dirpath Directory of the job file.
+/// @param name Name of the job file.
+/// @param max_threads Number of threads to run the commands with.
+/// @return 0 if the job file was run, 1 otherwise.
+static int run_job_file(const char *dirpath, const char *name, int max_threads) {
+  int inputFd, outputFd, openFlags;
+  mode_t filePerms;
+  char buffer[PATH_MAX];
+
+  if (snprintf(buffer, sizeof(buffer), "%s/%s", dirpath, name) >= (int)sizeof(buffer)) {
+    fprintf(stderr, "Path too long: %s/%s\n", dirpath, name);
+    return 1;
+  }
+
+  if((inputFd = open(buffer, O_RDONLY)) == -1){
+    fprintf(stderr, "open error: %s\n", strerror(errno));
+    return 1;
+  };
+
+  openFlags = O_CREAT | O_WRONLY | O_APPEND |O_TRUNC;
+  filePerms = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH; 
+  char *extension = strrchr(buffer + strlen(dirpath) + 1, '.');
+  if (extension != NULL)
+    *extension = '\0';
+  if (strlen(buffer) + 5 > sizeof(buffer)) {
+    fprintf(stderr, "Path too long: %s.out\n", buffer);
+    return 1;
+  }
+  strcat(buffer, ".out");
+
+  if((outputFd = open(buffer, openFlags, filePerms)) == -1){
+    fprintf(stderr, "open error: %s\n", strerror(errno));
+    return 1;
+  };
+
+#if !PRECOMPILED_JOBS
+  pthread_t thread_array[max_threads+1];
+  struct CommandInfo cmd_info_array[max_threads+1];
+#endif
+
+  if (barrier_init(&thread_barrier, (unsigned int)max_threads)) {
+    fprintf(stderr, "Failed to initialize barrier\n");
+    return 1;
+  }
+  if (init_delay_queues((unsigned int)max_threads)) {
+    fprintf(stderr, "Failed to allocate wait queues\n");
+    return 1;
+  }
+
+#if PRECOMPILED_JOBS
+  if (run_jobs(inputFd, outputFd, max_threads))
+    return 1;
+#else
+  for (int i = 1; i <= max_threads; i++){
+    cmd_info_array[i].inputFd = inputFd;
+    cmd_info_array[i].outputFd = outputFd;
+    cmd_info_array[i].thread_id = (unsigned int)i;
+    if (pthread_create(&thread_array[i], NULL, process_command, (void *)&cmd_info_array[i]) != 0) {
+      // Threads already started would wait for the missing ones at the next BARRIER forever.
+      fprintf(stderr, "Error creating thread\n");
+      exit(1);
+    }
+  }
+
+  for (int i = 1; i <= max_threads; i++)
+    pthread_join(thread_array[i], NULL);
+#endif
+  barrier_destroy(&thread_barrier);
+  free_delay_queues();
+
+  parser_close(inputFd);
+  if(close (inputFd) == -1){
+    fprintf(stderr, "Error closing file\n");
+    return 1;
+  }
+  if(close (outputFd) == -1){
+    fprintf(stderr, "Error closing file\n");
+    return 1;
+  }
+#if REPORT_STATS
+  size_t hits, misses;
+  ems_cache_stats(&hits, &misses);
+  fprintf(stderr, "%s: event cache %zu hits, %zu misses\n", name, hits, misses);
+  fprintf(stderr, "%s: operation latencies\n", name);
+  ems_latency_report(stderr);
+#endif
+  return 0;
+}
+
+/// Waits for a child running a job file to finish and reports how long the file took.
+/// @param files Job files started so far.
+/// @param num_files Number of job files started so far.
+/// @param start_ms Time at which the first job file started.
+static void reap_child(struct JobFileEntry *files, size_t num_files, double start_ms) {
+  int stat;
+  pid_t cpid;
+  while ((cpid = wait(&stat)) == -1 && errno == EINTR)
+    ;
+  if (cpid == -1)
+    return;
+
+  double end_ms = now_ms();
+  printf("Child %d terminated with status: %d\n", cpid, stat);
+  for (size_t i = 0; i < num_files; i++) {
+    if (files[i].pid == cpid) {
+      printf("%s: %lld bytes, ran for %.1f ms, done %.1f ms after the first file started\n", files[i].name,
+             (long long)files[i].size, end_ms - files[i].start_ms, end_ms - start_ms);
+      break;
+    }
+  }
+}
+
 int main(int argc, char *argv[]) {
   unsigned int state_access_delay_ms = STATE_ACCESS_DELAY_MS;
-  int MAX_PROC, MAX_THREADS, n_proc;
-  
+  int MAX_PROC, MAX_THREADS;
 
-  n_proc = 0;
+  if (argc < 4) {
+    fprintf(stderr, "Usage: %s <jobs_dir> <max_proc> <max_threads> [delay]\n", argv[0]);
+    return 1;
+  }
   MAX_PROC = atoi(argv[2]);
   MAX_THREADS = atoi(argv[3]);
+  if (MAX_PROC < 1 || MAX_THREADS < 1) {
+    fprintf(stderr, "The number of processes and threads must be positive\n");
+    return 1;
+  }
 
   if (argc > 4) {
     char *endptr;
@@ -191,102 +556,74 @@ int main(int argc, char *argv[]) {
     return -1;
   }
 
-  int dp_n = 0;
-  pthread_t thread_array[MAX_THREADS+1];
-  struct CommandInfo cmd_info_array[MAX_THREADS+1];
-
+  // Every job file is listed first, so the largest ones can be handed out first.
+  struct JobFileEntry *files = NULL;
+  size_t num_files = 0, files_capacity = 0;
   while ((dp = readdir(dirp)) != NULL){
     if (!strcmp(dp->d_name, ".") || !strcmp(dp->d_name, "..") || strstr(dp->d_name, ".out") )
       continue;
-    
-    dp_n++;
-    int inputFd, outputFd, openFlags;
-    pid_t pid;
-    mode_t filePerms;
-    char buffer[50];
-
-    if (n_proc++ < MAX_PROC)
-      pid = fork();
-
-    if (pid < 0){
-      fprintf(stderr, "Error creating process.\n");
-      return -1;
-    }
-    if (!pid){
-      strcpy(buffer, dirpath);
-      strcat(buffer, "/");
-      strcat(buffer, dp->d_name);
-      buffer[strlen(buffer)] = '\0';
-      
-      if((inputFd = open(buffer, O_RDONLY)) == -1){
-        fprintf(stderr, "open error: %s\n", strerror(errno));
-        return -1;
-      };
-
-      openFlags = O_CREAT | O_WRONLY | O_APPEND |O_TRUNC;
-      filePerms = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH; 
-      strtok(buffer, ".");
-      strcat(buffer, ".out");
 
-      if((outputFd = open(buffer, openFlags, filePerms)) == -1){
-        fprintf(stderr, "open error: %s\n", strerror(errno));
-        return -1;
-      };
-
-      for (int i = 1; i <= MAX_THREADS; i++){
-        cmd_info_array[i].inputFd = inputFd;
-        cmd_info_array[i].outputFd = outputFd;
-        cmd_info_array[i].thread_id = (unsigned int)i;
-        if (pthread_create(&thread_array[i], NULL, process_command, (void *)&cmd_info_array[i]) != 0) {
-          fprintf(stderr, "Error creating thread\n");
-          return -1;
-        }
-      }
-
-      int result = 1;
-      int result_thread;
-      while(result){
-        result = 0;
-        for (int i = 1; i <= MAX_THREADS; i++){
-          pthread_join(thread_array[i], (void**)&result_thread);
-          if (result_thread == 1)
-            result = 1;
-        }
-        if (result == 1){
-          barrier = 0;
-          for (int i = 1; i <= MAX_THREADS; i++){
-            cmd_info_array[i].inputFd = inputFd;
-            cmd_info_array[i].outputFd = outputFd;
-            cmd_info_array[i].thread_id = (unsigned int)i;
-            if (pthread_create(&thread_array[i], NULL, process_command, (void *)&cmd_info_array[i]) != 0) {
-              fprintf(stderr, "Error creating thread\n");
-              return -1;
-            }
-          }  
-        }
-      }
+    char path[PATH_MAX];
+    struct stat st;
+    if (snprintf(path, sizeof(path), "%s/%s", dirpath, dp->d_name) >= (int)sizeof(path) || stat(path, &st) == -1 ||
+        !S_ISREG(st.st_mode))
+      continue;
 
-      if(close (inputFd) == -1){
-        fprintf(stderr, "Error closing file\n");
-        return -1;
-      }
-      if(close (outputFd) == -1){
-        fprintf(stderr, "Error closing file\n");
+    if (num_files == files_capacity) {
+      files_capacity = files_capacity == 0 ? 64 : files_capacity * 2;
+      struct JobFileEntry *grown = realloc(files, files_capacity * sizeof(struct JobFileEntry));
+      if (grown == NULL) {
+        fprintf(stderr, "Failed to allocate job file list\n");
         return -1;
       }
-      n_proc--;
-      exit(0);
+      files = grown;
     }
-  }
-  int stat;
-  for(int i = 0; i < dp_n; i++){
-    pid_t cpid = wait(&stat);
-    printf("Child %d terminated with status: %d\n", cpid, stat);
+    strcpy(files[num_files].name, dp->d_name);
+    files[num_files].size = st.st_size;
+    files[num_files].pid = 0;
+    num_files++;
   }
   if(closedir(dirp) == -1){
     fprintf(stderr, "Error closing directory\n");
     return -1;
   }
+  if (num_files > 0)
+    qsort(files, num_files, sizeof(struct JobFileEntry), compare_size_desc);
+
+  // At most MAX_PROC children run at once, and a finished one is replaced as soon as it is reaped.
+  int running = 0, ret = 0;
+  double start_ms = now_ms();
+  size_t started = 0;
+  for (size_t i = 0; i < num_files; i++) {
+    if (running == MAX_PROC) {
+      reap_child(files, i, start_ms);
+      running--;
+    }
+
+    fflush(stdout);  // Or the child would print whatever the parent had buffered again.
+    files[i].start_ms = now_ms();
+    pid_t pid = fork();
+    if (pid < 0){
+      // The children already running still finish their files and are reaped below.
+      fprintf(stderr, "Error creating process.\n");
+      ret = -1;
+      break;
+    }
+    if (!pid)
+      exit(run_job_file(dirpath, files[i].name, MAX_THREADS));
+
+    files[i].pid = pid;
+    started++;
+    running++;
+  }
+  while (running > 0) {
+    reap_child(files, started, start_ms);
+    running--;
+  }
+  if (ret == 0)
+    printf("Makespan of %zu job files with %d processes: %.1f ms\n", num_files, MAX_PROC, now_ms() - start_ms);
+
+  free(files);
   ems_terminate();
-  return 0;
+  return ret;
 }
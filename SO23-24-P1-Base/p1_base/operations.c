@@ -1,3 +1,6 @@
+#include <errno.h>
+#include <limits.h>
+#include <sched.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
@@ -5,14 +8,52 @@
 #include <unistd.h>
 #include <string.h>
 
+#include "constants.h"
 #include "eventlist.h"
+#include "latency.h"
+
+// Operations whose latency is recorded, named in latency_names.
+enum LatencyOp { LATENCY_CREATE, LATENCY_RESERVE, LATENCY_SHOW, LATENCY_LIST, NUM_LATENCY_OPS };
+_Static_assert(NUM_LATENCY_OPS <= LATENCY_MAX_OPS, "every operation gets its own histograms");
+static const char* const latency_names[NUM_LATENCY_OPS] = {"create", "reserve", "show", "list"};
+
+/// Marks a seat claimed by a reservation that has not committed yet.
+#define RESERVATION_PENDING UINT_MAX
 
 pthread_mutex_t mutex_out = PTHREAD_MUTEX_INITIALIZER;
-pthread_mutex_t event_lock = PTHREAD_MUTEX_INITIALIZER;
-pthread_mutex_t event_list_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Locks guarding the event list. With SHARED_STORE they live in the shared store, so they lock out other processes.
+struct ListLocks {
+  pthread_mutex_t event_lock;
+  pthread_mutex_t event_list_lock;
+};
+
+static struct ListLocks local_locks = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER};
+static struct ListLocks* locks = &local_locks;
+
+#define EVENT_CACHE_SIZE 8  // Event handles cached by each thread, direct-mapped by id.
+
+// Events resolved by a thread, valid until the state generation changes.
+struct EventCache {
+  unsigned long generation;
+  unsigned int ids[EVENT_CACHE_SIZE];
+  struct Event* events[EVENT_CACHE_SIZE];
+};
 
 static struct EventList* event_list = NULL;
 static unsigned int state_access_delay_ms = 0;
+static atomic_ulong state_generation = 1;  // Bumped whenever the state is torn down.
+static atomic_size_t cache_hits = 0, cache_misses = 0;
+static _Thread_local struct EventCache event_cache;
+
+// Output of a SHOW or LIST, rendered by a thread before it takes mutex_out to write it at once.
+struct OutputBuffer {
+  char* data;
+  size_t len, capacity;
+};
+
+static pthread_key_t output_key;  // Frees the output buffer of a thread when it exits.
+static _Thread_local struct OutputBuffer output;
 
 /// Calculates a timespec from a delay in milliseconds.
 /// @param delay_ms Delay in milliseconds.
@@ -21,16 +62,57 @@ static struct timespec delay_to_timespec(unsigned int delay_ms) {
   return (struct timespec){delay_ms / 1000, (delay_ms % 1000) * 1000000};
 }
 
+/// Locks a mutex, counting the time spent waiting for it as lock wait.
+/// @param mutex Mutex to lock.
+static void lock_mutex(pthread_mutex_t* mutex) {
+  uint64_t start = latency_now();
+  pthread_mutex_lock(mutex);
+  latency_add(LATENCY_LOCK_WAIT, start);
+}
+
+/// Sleeps for the state access delay, counting it as delay.
+static void access_delay() {
+  struct timespec delay = delay_to_timespec(state_access_delay_ms);
+  uint64_t start = latency_now();
+  nanosleep(&delay, NULL);  // Should not be removed
+  latency_add(LATENCY_DELAY, start);
+}
+
 /// Gets the event with the given ID from the state.
 /// @note Will wait to simulate a real system accessing a costly memory resource.
 /// @param event_id The ID of the event to get.
 /// @return Pointer to the event if found, NULL otherwise.
 static struct Event* get_event_with_delay(unsigned int event_id) {
-  struct timespec delay = delay_to_timespec(state_access_delay_ms);
-  nanosleep(&delay, NULL);  // Should not be removed
-  pthread_mutex_lock(&event_lock);
+  access_delay();
+  lock_mutex(&locks->event_lock);
   struct Event* event = get_event(event_list, event_id);
-  pthread_mutex_unlock(&event_lock);
+  pthread_mutex_unlock(&locks->event_lock);
+  return event;
+}
+
+/// Gets the event with the given ID, from the calling thread's cache when possible.
+/// @note Only misses pay for get_event_with_delay. Missing events are not cached, as they may be created later.
+/// @param event_id The ID of the event to get.
+/// @return Pointer to the event if found, NULL otherwise.
+static struct Event* get_cached_event(unsigned int event_id) {
+  unsigned long generation = atomic_load(&state_generation);
+  if (event_cache.generation != generation) {
+    memset(&event_cache, 0, sizeof(event_cache));
+    event_cache.generation = generation;
+  }
+
+  size_t slot = event_id % EVENT_CACHE_SIZE;
+  if (event_cache.events[slot] != NULL && event_cache.ids[slot] == event_id) {
+    atomic_fetch_add_explicit(&cache_hits, 1, memory_order_relaxed);
+    return event_cache.events[slot];
+  }
+
+  atomic_fetch_add_explicit(&cache_misses, 1, memory_order_relaxed);
+  struct Event* event = get_event_with_delay(event_id);
+  if (event != NULL) {
+    event_cache.ids[slot] = event_id;
+    event_cache.events[slot] = event;
+  }
   return event;
 }
 
@@ -39,13 +121,88 @@ static struct Event* get_event_with_delay(unsigned int event_id) {
 /// @param event Event to get the seat from.
 /// @param index Index of the seat to get.
 /// @return Pointer to the seat.
-static unsigned int* get_seat_with_delay(struct Event* event, size_t index) {
-  struct timespec delay = delay_to_timespec(state_access_delay_ms);
-  nanosleep(&delay, NULL);  // Should not be removed
-  unsigned int *data = &event->data[index]; 
+static atomic_uint* get_seat_with_delay(struct Event* event, size_t index) {
+  access_delay();
+  atomic_uint *data = &event->data[index]; 
   return data;
 }
 
+#if OPTIMISTIC_RESERVE
+/// Claims a free seat for a reservation, waiting while another reservation holds it pending.
+/// @param seat Seat to claim.
+/// @return 0 if the seat was claimed, 1 if it is reserved.
+static int claim_seat(atomic_uint* seat) {
+  unsigned int expected = 0;
+  while (!atomic_compare_exchange_weak(seat, &expected, RESERVATION_PENDING)) {
+    // A pending reservation either takes the seat or gives it back, which only the wait tells apart.
+    if (expected != 0 && expected != RESERVATION_PENDING) return 1;
+    if (expected == RESERVATION_PENDING) sched_yield();
+    expected = 0;
+  }
+  return 0;
+}
+
+/// Reads a seat once no reservation holds it pending.
+/// @param seat Seat to read.
+/// @return Reservation id of the seat, 0 if it is free.
+static unsigned int settled_seat(atomic_uint* seat) {
+  unsigned int value;
+  while ((value = atomic_load(seat)) == RESERVATION_PENDING) sched_yield();
+  return value;
+}
+#endif
+
+/// Makes room for more bytes at the end of the calling thread's output buffer.
+/// @param bytes Number of bytes to make room for.
+/// @return 0 if there is room, 1 if memory ran out.
+static int output_reserve(size_t bytes) {
+  if (output.capacity - output.len >= bytes) return 0;
+
+  size_t capacity = output.capacity == 0 ? 4096 : output.capacity;
+  while (capacity - output.len < bytes) capacity *= 2;
+  char* data = realloc(output.data, capacity);
+  if (data == NULL) return 1;
+  output.data = data;
+  output.capacity = capacity;
+  pthread_setspecific(output_key, data);
+  return 0;
+}
+
+/// Appends a number to the calling thread's output buffer.
+/// @note Room for it must have been made with output_reserve.
+/// @param value Number to append.
+static void output_uint(unsigned int value) {
+  char digits[10];
+  size_t n = 0;
+  do {
+    digits[n++] = (char)('0' + value % 10);
+    value /= 10;
+  } while (value != 0);
+
+  while (n > 0) output.data[output.len++] = digits[--n];
+}
+
+/// Writes the calling thread's output buffer to a file and empties it.
+/// @param fd File descriptor to write to.
+/// @return 0 if everything was written, 1 otherwise.
+static int output_flush(int fd) {
+  size_t written = 0;
+  int result = 0;
+  lock_mutex(&mutex_out);
+  while (written < output.len) {
+    ssize_t bytes = write(fd, output.data + written, output.len - written);
+    if (bytes < 0) {
+      if (errno == EINTR) continue;
+      result = 1;
+      break;
+    }
+    written += (size_t)bytes;
+  }
+  pthread_mutex_unlock(&mutex_out);
+  output.len = 0;
+  return result;
+}
+
 /// Gets the index of a seat.
 /// @note This function assumes that the seat exists.
 /// @param event Event to get the seat index from.
@@ -63,10 +220,42 @@ int ems_init(unsigned int delay_ms) {
     return 1;
   }
 
-  event_list = create_list();
+  if (pthread_key_create(&output_key, free) != 0) {
+    fprintf(stderr, "Failed to create output buffer key\n");
+    return 1;
+  }
+
   state_access_delay_ms = delay_ms;
+#if SHARED_STORE
+  event_list = create_shared_list(SHARED_STORE_SIZE);
+  if (event_list == NULL) {
+    pthread_key_delete(output_key);
+    return 1;
+  }
 
-  return event_list == NULL;
+  locks = arena_alloc(&event_list->arena, sizeof(struct ListLocks));
+  pthread_mutexattr_t attr;
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+  if (locks == NULL || pthread_mutex_init(&locks->event_lock, &attr) != 0 ||
+      pthread_mutex_init(&locks->event_list_lock, &attr) != 0) {
+    pthread_mutexattr_destroy(&attr);
+    locks = &local_locks;
+    free_list(event_list);
+    event_list = NULL;
+    pthread_key_delete(output_key);
+    return 1;
+  }
+  pthread_mutexattr_destroy(&attr);
+#else
+  event_list = create_list();
+  if (event_list == NULL) {
+    pthread_key_delete(output_key);
+    return 1;
+  }
+#endif
+
+  return 0;
 }
 
 int ems_terminate() {
@@ -75,70 +264,78 @@ int ems_terminate() {
     return 1;
   }
 
+  atomic_fetch_add(&state_generation, 1);
   free_list(event_list);
+  event_list = NULL;
+  locks = &local_locks;
+
+  // Threads free their own buffers when they exit, the calling one may still have one.
+  pthread_key_delete(output_key);
+  free(output.data);
+  memset(&output, 0, sizeof(output));
   return 0;
 }
 
-int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols) {
+/// Creates a new event with the given id and dimensions.
+/// @return 0 if the event was created successfully, 1 otherwise.
+static int create(unsigned int event_id, size_t num_rows, size_t num_cols) {
   if (event_list == NULL) {
     fprintf(stderr, "EMS state must be initialized\n");
     return 1;
   }
 
-  if (get_event_with_delay(event_id) != NULL) {
+  if (get_cached_event(event_id) != NULL) {
     fprintf(stderr, "Event already exists\n");
     return 1;
   }
 
-  pthread_mutex_lock(&event_lock);
-  struct Event* event = malloc(sizeof(struct Event));
-  pthread_mutex_unlock(&event_lock);
-
-  if (event == NULL) {
-    fprintf(stderr, "Error allocating memory for event\n");
+  lock_mutex(&locks->event_lock);
+  lock_mutex(&locks->event_list_lock);
+  // Another thread, or process with SHARED_STORE, may have created it since it was looked up.
+  if (get_event(event_list, event_id) != NULL) {
+    fprintf(stderr, "Event already exists\n");
+    pthread_mutex_unlock(&locks->event_list_lock);
+    pthread_mutex_unlock(&locks->event_lock);
     return 1;
   }
-  pthread_mutex_init(&event->event_mutex, NULL);
-  pthread_mutex_lock(&event_lock);
-  event->id = event_id;
-  event->rows = num_rows;
-  event->cols = num_cols;
-  event->reservations = 0;
-  
-  event->data = malloc(num_rows * num_cols * sizeof(unsigned int));
 
-  if (event->data == NULL) {
-    fprintf(stderr, "Error allocating memory for event data\n");
-    pthread_mutex_unlock(&event_lock);
-    free(event);
-    return 1;
-  }
+  struct Event* event = create_event(event_list, event_id, num_rows, num_cols);
 
-  for (size_t i = 0; i < num_rows * num_cols; i++) {
-    event->data[i] = 0;
+  if (event == NULL) {
+    fprintf(stderr, "Error allocating memory for event\n");
+    pthread_mutex_unlock(&locks->event_list_lock);
+    pthread_mutex_unlock(&locks->event_lock);
+    return 1;
   }
 
-  pthread_mutex_lock(&event_list_lock);
   if (append_to_list(event_list, event) != 0) {
     fprintf(stderr, "Error appending event to list\n");
-    pthread_mutex_unlock(&event_lock);
-    pthread_mutex_unlock(&event_list_lock);
-    free(event->data);
-    free(event);
+    discard_event(event_list, event);
+    pthread_mutex_unlock(&locks->event_list_lock);
+    pthread_mutex_unlock(&locks->event_lock);
     return 1;
   }
-  pthread_mutex_unlock(&event_list_lock);
-  pthread_mutex_unlock(&event_lock);
+  pthread_mutex_unlock(&locks->event_list_lock);
+  pthread_mutex_unlock(&locks->event_lock);
   return 0;
 }
 
-int ems_reserve(unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys) {
+int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols) {
+  latency_begin();
+  int ret = create(event_id, num_rows, num_cols);
+  latency_end(LATENCY_CREATE);
+  return ret;
+}
+
+/// Creates a new reservation for the given event.
+/// @return 0 if the reservation was created successfully, 1 otherwise.
+static int reserve(unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys) {
   if (event_list == NULL) {
     fprintf(stderr, "EMS state must be initialized\n");
     return 1;
   }
 
-  struct Event* event = get_event_with_delay(event_id);
+  struct Event* event = get_cached_event(event_id);
 
   
 
@@ -146,7 +343,53 @@ int ems_reserve(unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys)
     fprintf(stderr, "Event not found\n");
     return 1;
   }
-  pthread_mutex_lock(&event->event_mutex);
+
+#if OPTIMISTIC_RESERVE
+  if (num_seats > MAX_RESERVATION_SIZE) {
+    fprintf(stderr, "Invalid seat\n");
+    return 1;
+  }
+
+  // Seats are claimed one by one with CAS in index order, so no event-wide lock is held across the seat delays and
+  // reservations waiting on each other's pending seats never wait in a cycle.
+  size_t indices[MAX_RESERVATION_SIZE];
+  for (size_t i = 0; i < num_seats; i++) {
+    if (xs[i] <= 0 || xs[i] > event->rows || ys[i] <= 0 || ys[i] > event->cols) {
+      fprintf(stderr, "Invalid seat\n");
+      return 1;
+    }
+
+    size_t index = seat_index(event, xs[i], ys[i]), j = i;
+    for (; j > 0 && indices[j - 1] > index; j--) indices[j] = indices[j - 1];
+    indices[j] = index;
+  }
+
+  size_t claimed = 0;
+  for (; claimed < num_seats; claimed++) {
+    // A seat given twice would otherwise wait on its own claim.
+    if ((claimed > 0 && indices[claimed] == indices[claimed - 1]) ||
+        claim_seat(get_seat_with_delay(event, indices[claimed])) != 0) {
+      fprintf(stderr, "Seat already reserved\n");
+      break;
+    }
+  }
+
+  // If the reservation was not successful, release the seats claimed so far.
+  if (claimed < num_seats) {
+    for (size_t j = 0; j < claimed; j++) {
+      atomic_store(get_seat_with_delay(event, indices[j]), 0);
+    }
+    return 1;
+  }
+
+  // The id is only taken once every seat is held, so failed attempts do not leave gaps.
+  unsigned int reservation_id = atomic_fetch_add(&event->reservations, 1) + 1;
+  for (size_t j = 0; j < num_seats; j++) {
+    atomic_store(get_seat_with_delay(event, indices[j]), reservation_id);
+  }
+  return 0;
+#else
+  lock_mutex(&event->event_mutex);
   unsigned int reservation_id = ++event->reservations;
 
   size_t i = 0;
@@ -179,75 +422,131 @@ int ems_reserve(unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys)
 
   pthread_mutex_unlock(&event->event_mutex);
   return 0;
+#endif
 }
 
-int ems_show(unsigned int event_id, int fd) {
+int ems_reserve(unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys) {
+  latency_begin();
+  int ret = reserve(event_id, num_seats, xs, ys);
+  latency_end(LATENCY_RESERVE);
+  return ret;
+}
+
+/// Prints the given event.
+/// @return 0 if the event was printed successfully, 1 otherwise.
+static int show(unsigned int event_id, int fd) {
   if (event_list == NULL) {
     fprintf(stderr, "EMS state must be initialized\n");
     return 1;
   }
 
-  struct Event* event = get_event_with_delay(event_id);
+  struct Event* event = get_cached_event(event_id);
   
   if (event == NULL) {
     fprintf(stderr, "Event not found\n");
     return 1;
   }
-  pthread_mutex_lock(&mutex_out);
-  pthread_mutex_lock(&event->event_mutex);
+#if OPTIMISTIC_RESERVE
+  // Reservations that took their id before the SHOW started already hold all their seats, and are waited out. Later
+  // ones are left out whole, as if they came after it.
+  unsigned int newest = atomic_load(&event->reservations);
+#else
+  lock_mutex(&event->event_mutex);
+#endif
   for (size_t i = 1; i <= event->rows; i++) {
-    for (size_t j = 1; j <= event->cols; j++) {
-      unsigned int* seat = get_seat_with_delay(event, seat_index(event, i, j));
-      char seatstr[10];
-      sprintf(seatstr, "%u", *seat);
-      seatstr[strlen(seatstr)] = '\0';
-      write(fd, seatstr, sizeof(char)*(strlen(seatstr)));
+    // Up to 10 digits and a separator per seat, and the end of the row.
+    if (output_reserve(event->cols * 11 + 1)) {
+#if !OPTIMISTIC_RESERVE
+      pthread_mutex_unlock(&event->event_mutex);
+#endif
+      output.len = 0;
+      fprintf(stderr, "Failed to allocate output buffer\n");
+      return 1;
+    }
 
+    for (size_t j = 1; j <= event->cols; j++) {
+#if OPTIMISTIC_RESERVE
+      unsigned int seat = settled_seat(get_seat_with_delay(event, seat_index(event, i, j)));
+      if (seat > newest) {
+        seat = 0;
+      }
+#else
+      unsigned int seat = atomic_load(get_seat_with_delay(event, seat_index(event, i, j)));
+#endif
+      output_uint(seat);
       if (j < event->cols) {
-        write(fd, " ", 1);
+        output.data[output.len++] = ' ';
       }
     }
-
-    write(fd, "\n", 1);
+    output.data[output.len++] = '\n';
   }
+#if !OPTIMISTIC_RESERVE
   pthread_mutex_unlock(&event->event_mutex);
-  pthread_mutex_unlock(&mutex_out);
-  return 0;
+#endif
+  return output_flush(fd);
 }
 
-int ems_list_events(int fd) {
+int ems_show(unsigned int event_id, int fd) {
+  latency_begin();
+  int ret = show(event_id, fd);
+  latency_end(LATENCY_SHOW);
+  return ret;
+}
+
+/// Prints all the events.
+/// @return 0 if the events were printed successfully, 1 otherwise.
+static int list_events(int fd) {
   if (event_list == NULL) {
     fprintf(stderr, "EMS state must be initialized\n");
     return 1;
   }
 
-  pthread_mutex_lock(&mutex_out);
-  pthread_mutex_lock(&event_list_lock);
+  lock_mutex(&locks->event_list_lock);
   if (event_list->head == NULL) {
-    write(fd, "No events\n", 10);
-    pthread_mutex_unlock(&event_list_lock);
-    pthread_mutex_unlock(&mutex_out);
-    return 0;
+    pthread_mutex_unlock(&locks->event_list_lock);
+    if (output_reserve(10)) {
+      fprintf(stderr, "Failed to allocate output buffer\n");
+      return 1;
+    }
+    memcpy(output.data, "No events\n", 10);
+    output.len = 10;
+    return output_flush(fd);
   }
 
   struct ListNode* current = event_list->head;
   while (current != NULL) {
-    pthread_mutex_lock(&((current->event)->event_mutex));
-    write(fd, "Event: ", 7);
-    char eventidstr[10];
-    sprintf(eventidstr, "%u", (current->event)->id);
-    eventidstr[strlen(eventidstr)] = '\0';
-    write(fd, eventidstr, sizeof(char)*(strlen(eventidstr)));
-    write(fd, "\n", 1);
-    pthread_mutex_unlock(&((current->event)->event_mutex));
+    // "Event: ", up to 10 digits and a newline.
+    if (output_reserve(18)) {
+      pthread_mutex_unlock(&locks->event_list_lock);
+      output.len = 0;
+      fprintf(stderr, "Failed to allocate output buffer\n");
+      return 1;
+    }
+    memcpy(output.data + output.len, "Event: ", 7);
+    output.len += 7;
+    output_uint((current->event)->id);
+    output.data[output.len++] = '\n';
     current = current->next;
   }
-  pthread_mutex_unlock(&event_list_lock);
-  pthread_mutex_unlock(&mutex_out);
-  return 0;
+  pthread_mutex_unlock(&locks->event_list_lock);
+  return output_flush(fd);
+}
+
+int ems_list_events(int fd) {
+  latency_begin();
+  int ret = list_events(fd);
+  latency_end(LATENCY_LIST);
+  return ret;
 }
 
 void ems_wait(unsigned int delay_ms) {
   struct timespec delay = delay_to_timespec(delay_ms);
   nanosleep(&delay, NULL);
 }
+
+void ems_cache_stats(size_t* hits, size_t* misses) {
+  *hits = atomic_load(&cache_hits);
+  *misses = atomic_load(&cache_misses);
+}
+
+void ems_latency_report(FILE* out) { latency_report(out, latency_names, NUM_LATENCY_OPS); }
@@ -2,6 +2,7 @@
 #define EMS_OPERATIONS_H
 
 #include <stddef.h>
+#include <stdio.h>
 
 /// Initializes the EMS state.
 /// @param delay_ms State access delay in milliseconds.
@@ -40,4 +41,13 @@ int ems_list_events(int fd);
 /// @param delay_us Delay in milliseconds.
 void ems_wait(unsigned int delay_ms);
 
+/// Gets the counters of the per-thread event handle caches.
+/// @param hits Pointer to the variable to store the number of lookups served from a cache in.
+/// @param misses Pointer to the variable to store the number of lookups that went to the state in.
+void ems_cache_stats(size_t *hits, size_t *misses);
+
+/// Prints p50/p90/p99/max latencies per operation and phase, merged over every thread.
+/// @param out File to print the report to.
+void ems_latency_report(FILE *out);
+
 #endif  // EMS_OPERATIONS_H
@@ -7,12 +7,63 @@
 
 #include "constants.h"
 
+#define PARSER_BUFFER_SIZE 65536  // Bytes read from a job file per read syscall.
+#define PARSER_MAX_FDS 1024       // File descriptors at or above this are read unbuffered.
+
+// Input already read from a file descriptor but not parsed yet.
+struct Reader {
+  size_t pos;                     // Next byte of data to hand out.
+  size_t len;                     // Number of bytes of data read.
+  char data[PARSER_BUFFER_SIZE];  // Buffered input.
+};
+
+// Readers of the file descriptors parsed so far, allocated on first use.
+static struct Reader *readers[PARSER_MAX_FDS];
+
+/// Reads from a file descriptor through its buffer, like read but only returning less than asked for at EOF.
+/// @param fd File descriptor to read from.
+/// @param dest Buffer to store the bytes in.
+/// @param count Number of bytes to read.
+/// @return Number of bytes read, -1 if nothing could be read because of an error.
+static ssize_t buffered_read(int fd, void *dest, size_t count) {
+  if (fd < 0 || fd >= PARSER_MAX_FDS) return read(fd, dest, count);
+
+  struct Reader *reader = readers[fd];
+  if (reader == NULL) {
+    reader = readers[fd] = malloc(sizeof(struct Reader));
+    if (reader == NULL) return read(fd, dest, count);
+    reader->pos = reader->len = 0;
+  }
+
+  size_t copied = 0;
+  while (copied < count) {
+    if (reader->pos == reader->len) {
+      ssize_t bytes = read(fd, reader->data, PARSER_BUFFER_SIZE);
+      if (bytes <= 0) return copied > 0 ? (ssize_t)copied : bytes;
+      reader->pos = 0;
+      reader->len = (size_t)bytes;
+    }
+
+    size_t chunk = reader->len - reader->pos < count - copied ? reader->len - reader->pos : count - copied;
+    memcpy((char *)dest + copied, reader->data + reader->pos, chunk);
+    reader->pos += chunk;
+    copied += chunk;
+  }
+  return (ssize_t)copied;
+}
+
+void parser_close(int fd) {
+  if (fd < 0 || fd >= PARSER_MAX_FDS) return;
+  free(readers[fd]);
+  readers[fd] = NULL;
+}
+
 static int read_uint(int fd, unsigned int *value, char *next) {
   char buf[16];
 
   int i = 0;
   while (1) {
-    if (read(fd, buf + i, 1) == 0) {
+    if (buffered_read(fd, buf + i, 1) == 0) {
       *next = '\0';
       break;
     }
@@ -40,19 +91,19 @@ static int read_uint(int fd, unsigned int *value, char *next) {
 
 static void cleanup(int fd) {
   char ch;
-  while (read(fd, &ch, 1) == 1 && ch != '\n')
+  while (buffered_read(fd, &ch, 1) == 1 && ch != '\n')
     ;
 }
 
 enum Command get_next(int fd) {
   char buf[16];
-  if (read(fd, buf, 1) != 1) {
+  if (buffered_read(fd, buf, 1) != 1) {
     return EOC;
   }
 
   switch (buf[0]) {
     case 'C':
-      if (read(fd, buf + 1, 6) != 6 || strncmp(buf, "CREATE ", 7) != 0) {
+      if (buffered_read(fd, buf + 1, 6) != 6 || strncmp(buf, "CREATE ", 7) != 0) {
         cleanup(fd);
         return CMD_INVALID;
       }
@@ -60,7 +111,7 @@ enum Command get_next(int fd) {
       return CMD_CREATE;
 
     case 'R':
-      if (read(fd, buf + 1, 7) != 7 || strncmp(buf, "RESERVE ", 8) != 0) {
+      if (buffered_read(fd, buf + 1, 7) != 7 || strncmp(buf, "RESERVE ", 8) != 0) {
         cleanup(fd);
         return CMD_INVALID;
       }
@@ -68,7 +119,7 @@ enum Command get_next(int fd) {
       return CMD_RESERVE;
 
     case 'S':
-      if (read(fd, buf + 1, 4) != 4 || strncmp(buf, "SHOW ", 5) != 0) {
+      if (buffered_read(fd, buf + 1, 4) != 4 || strncmp(buf, "SHOW ", 5) != 0) {
         cleanup(fd);
         return CMD_INVALID;
       }
@@ -76,12 +127,12 @@ enum Command get_next(int fd) {
       return CMD_SHOW;
 
     case 'L':
-      if (read(fd, buf + 1, 3) != 3 || strncmp(buf, "LIST", 4) != 0) {
+      if (buffered_read(fd, buf + 1, 3) != 3 || strncmp(buf, "LIST", 4) != 0) {
         cleanup(fd);
         return CMD_INVALID;
       }
 
-      if (read(fd, buf + 4, 1) != 0 && buf[4] != '\n') {
+      if (buffered_read(fd, buf + 4, 1) != 0 && buf[4] != '\n') {
         cleanup(fd);
         return CMD_INVALID;
       }
@@ -89,12 +140,12 @@ enum Command get_next(int fd) {
       return CMD_LIST_EVENTS;
 
     case 'B':
-      if (read(fd, buf + 1, 6) != 6 || strncmp(buf, "BARRIER", 7) != 0) {
+      if (buffered_read(fd, buf + 1, 6) != 6 || strncmp(buf, "BARRIER", 7) != 0) {
         cleanup(fd);
         return CMD_INVALID;
       }
 
-      if (read(fd, buf + 7, 1) != 0 && buf[7] != '\n') {
+      if (buffered_read(fd, buf + 7, 1) != 0 && buf[7] != '\n') {
         cleanup(fd);
         return CMD_INVALID;
       }
@@ -102,7 +153,7 @@ enum Command get_next(int fd) {
       return CMD_BARRIER;
 
     case 'W':
-      if (read(fd, buf + 1, 4) != 4 || strncmp(buf, "WAIT ", 5) != 0) {
+      if (buffered_read(fd, buf + 1, 4) != 4 || strncmp(buf, "WAIT ", 5) != 0) {
         cleanup(fd);
         return CMD_INVALID;
       }
@@ -110,12 +161,12 @@ enum Command get_next(int fd) {
       return CMD_WAIT;
 
     case 'H':
-      if (read(fd, buf + 1, 3) != 3 || strncmp(buf, "HELP", 4) != 0) {
+      if (buffered_read(fd, buf + 1, 3) != 3 || strncmp(buf, "HELP", 4) != 0) {
         cleanup(fd);
         return CMD_INVALID;
       }
 
-      if (read(fd, buf + 4, 1) != 0 && buf[4] != '\n') {
+      if (buffered_read(fd, buf + 4, 1) != 0 && buf[4] != '\n') {
         cleanup(fd);
         return CMD_INVALID;
       }
@@ -168,14 +219,14 @@ size_t parse_reserve(int fd, size_t max, unsigned int *event_id, size_t *xs, siz
     return 0;
   }
 
-  if (read(fd, &ch, 1) != 1 || ch != '[') {
+  if (buffered_read(fd, &ch, 1) != 1 || ch != '[') {
     cleanup(fd);
     return 0;
   }
 
   size_t num_coords = 0;
   while (num_coords < max) {
-    if (read(fd, &ch, 1) != 1 || ch != '(') {
+    if (buffered_read(fd, &ch, 1) != 1 || ch != '(') {
       cleanup(fd);
       return 0;
     }
@@ -196,7 +247,7 @@ size_t parse_reserve(int fd, size_t max, unsigned int *event_id, size_t *xs, siz
 
     num_coords++;
 
-    if (read(fd, &ch, 1) != 1 || (ch != ' ' && ch != ']')) {
+    if (buffered_read(fd, &ch, 1) != 1 || (ch != ' ' && ch != ']')) {
       cleanup(fd);
       return 0;
     }
@@ -211,7 +262,7 @@ size_t parse_reserve(int fd, size_t max, unsigned int *event_id, size_t *xs, siz
     return 0;
   }
 
-  if (read(fd, &ch, 1) != 1 || (ch != '\n' && ch != '\0')) {
+  if (buffered_read(fd, &ch, 1) != 1 || (ch != '\n' && ch != '\0')) {
     cleanup(fd);
     return 0;
   }
@@ -16,6 +16,13 @@ enum Command {
   EOC  // End of commands
 };
 
+// Input is read through a buffer per file descriptor, so calls parsing the same file descriptor must be
+// serialized by the caller, as a command already spans several of them.
+
+/// Forgets the buffered input of a file descriptor. Must be called before closing one that was parsed.
+/// @param fd File descriptor to forget.
+void parser_close(int fd);
+
 /// Reads a line and returns the corresponding command.
 /// @param fd File descriptor to read from.
 /// @return The command read.
@@ -0,0 +1,85 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "common/constants.h"
+#include "server/operations.h"
+
+#define NUM_EVENTS 100000
+#define ROWS 10
+#define COLS 10
+#define STADIUM_SIDE 10000  // Rows and columns of the stadium, stored sparsely.
+#define STADIUM_RUNS 400    // Runs of MAX_RESERVATION_SIZE seats reserved in the stadium, about 1% of it.
+
+/// Returns the current monotonic time in seconds.
+static double now_s() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/// Reads the resident set size of the process.
+/// @return Resident set size in KiB, 0 if it could not be read.
+static long rss_kib() {
+  long pages = 0, resident = 0;
+  FILE* statm = fopen("/proc/self/statm", "r");
+  if (!statm) return 0;
+  if (fscanf(statm, "%ld %ld", &pages, &resident) != 2) resident = 0;
+  fclose(statm);
+  return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+int main() {
+  if (ems_init(0) != 0) {
+    fprintf(stderr, "Failed to initialize EMS\n");
+    return 1;
+  }
+
+  long rss_before = rss_kib();
+  double start = now_s();
+  for (unsigned int id = 1; id <= NUM_EVENTS; id++) {
+    if (ems_create(id, ROWS, COLS) != 0) {
+      fprintf(stderr, "Failed to create event %u\n", id);
+      return 1;
+    }
+  }
+  double create_s = now_s() - start;
+  long rss_after = rss_kib();
+
+  start = now_s();
+  ems_terminate();
+  double terminate_s = now_s() - start;
+
+  printf("%d events of %dx%d\n", NUM_EVENTS, ROWS, COLS);
+  printf("create:    %.3f s\n", create_s);
+  printf("terminate: %.3f s\n", terminate_s);
+  printf("rss:       %ld KiB -> %ld KiB\n", rss_before, rss_after);
+
+  // A huge venue with a few blocks of seats sold, which would take 400 MB of seats if stored densely.
+  if (ems_init(0) != 0 || ems_create(1, STADIUM_SIDE, STADIUM_SIDE) != 0) {
+    fprintf(stderr, "Failed to create stadium\n");
+    return 1;
+  }
+
+  rss_before = rss_kib();
+  srand(1);
+  size_t xs[MAX_RESERVATION_SIZE], ys[MAX_RESERVATION_SIZE];
+  for (int run = 0; run < STADIUM_RUNS; run++) {
+    size_t row = 1 + (size_t)rand() % STADIUM_SIDE;
+    size_t first_col = 1 + (size_t)rand() % (STADIUM_SIDE - MAX_RESERVATION_SIZE);
+    for (size_t i = 0; i < MAX_RESERVATION_SIZE; i++) {
+      xs[i] = row;
+      ys[i] = first_col + i;
+    }
+    ems_reserve(1, MAX_RESERVATION_SIZE, xs, ys);
+  }
+  rss_after = rss_kib();
+
+  printf("\n1 event of %dx%d with %d runs of %d seats reserved\n", STADIUM_SIDE, STADIUM_SIDE, STADIUM_RUNS,
+         MAX_RESERVATION_SIZE);
+  ems_memory_report(stdout);
+  printf("rss:       %ld KiB -> %ld KiB\n", rss_before, rss_after);
+  ems_terminate();
+  return 0;
+}
@@ -0,0 +1,95 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "common/constants.h"
+#include "server/operations.h"
+
+#define EVENT_ID 1
+#define ROWS_PER_THREAD 1000
+#define COLS MAX_RESERVATION_SIZE
+#define MAX_THREADS 8
+
+struct Worker {
+  pthread_t thread;
+  size_t first_row;
+  int failures;
+};
+
+/// Returns the current monotonic time in seconds.
+static double now_s() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/// Reserves every row of the worker's block, one full row per request.
+static void* reserve_block(void* arg) {
+  struct Worker* worker = (struct Worker*)arg;
+  size_t xs[COLS], ys[COLS];
+
+  for (size_t row = worker->first_row; row < worker->first_row + ROWS_PER_THREAD; row++) {
+    for (size_t col = 0; col < COLS; col++) {
+      xs[col] = row;
+      ys[col] = col + 1;
+    }
+    worker->failures += ems_reserve(EVENT_ID, COLS, xs, ys);
+  }
+  return NULL;
+}
+
+/// Usage: bench/contention [log_path [async]]
+/// With a log path, every reservation is also logged there, waiting for its group commit unless async is given.
+int main(int argc, char* argv[]) {
+  const char* log_path = argc > 1 ? argv[1] : NULL;
+  int async_log = argc > 2;
+  if (log_path != NULL) {
+    unlink(log_path);
+  }
+
+  printf("%8s %14s %14s\n", "threads", "reserves/s", "seats/s");
+
+  for (size_t num_threads = 1; num_threads <= MAX_THREADS; num_threads *= 2) {
+    if (ems_init(0) != 0 || ems_create(EVENT_ID, num_threads * ROWS_PER_THREAD, COLS) != 0) {
+      fprintf(stderr, "Failed to initialize EMS\n");
+      return 1;
+    }
+
+    // The log outlives the state, so it is only opened for the first run.
+    if (log_path != NULL && num_threads == 1 && ems_open_log(log_path, async_log) != 0) {
+      fprintf(stderr, "Failed to open log\n");
+      return 1;
+    }
+
+    struct Worker workers[MAX_THREADS];
+    double start = now_s();
+    for (size_t i = 0; i < num_threads; i++) {
+      workers[i].first_row = i * ROWS_PER_THREAD + 1;
+      workers[i].failures = 0;
+      if (pthread_create(&workers[i].thread, NULL, reserve_block, &workers[i]) != 0) {
+        fprintf(stderr, "Error creating thread\n");
+        return 1;
+      }
+    }
+
+    int failures = 0;
+    for (size_t i = 0; i < num_threads; i++) {
+      pthread_join(workers[i].thread, NULL);
+      failures += workers[i].failures;
+    }
+    double elapsed = now_s() - start;
+
+    if (failures != 0) {
+      fprintf(stderr, "%d reservations failed\n", failures);
+      return 1;
+    }
+
+    double reserves = (double)(num_threads * ROWS_PER_THREAD);
+    printf("%8zu %14.0f %14.0f\n", num_threads, reserves / elapsed, reserves * COLS / elapsed);
+    ems_terminate();
+  }
+
+  return 0;
+}
@@ -0,0 +1,186 @@
+#define _DEFAULT_SOURCE  // random and srandom are not part of POSIX.1-2008
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "common/constants.h"
+
+// Parameters of a generated job file.
+struct Workload {
+  unsigned int events;       // Events created at the start of the file.
+  size_t rows, cols;         // Dimensions of every event.
+  unsigned int commands;     // Commands after the CREATEs.
+  double seats_mean;         // Mean number of seats per RESERVE, geometrically distributed.
+  double skew;               // Zipf exponent of the event each command targets, 0 for uniform.
+  double show_ratio;         // Fraction of the commands that are SHOWs.
+  double list_ratio;         // Fraction of the commands that are LISTs.
+  double wait_ratio;         // Fraction of the commands that are WAITs.
+  double barrier_ratio;      // Fraction of the commands that are BARRIERs, which only P1 understands.
+  unsigned int wait_ms;      // Delay of every WAIT.
+  unsigned int first_event;  // Id of the first event, so files meant to run together can use distinct ids.
+  unsigned int seed;         // Seed of the generator, so the same parameters give the same file.
+};
+
+/// Returns a uniformly distributed number in [0, 1).
+static double uniform() { return (double)random() / ((double)RAND_MAX + 1.0); }
+
+/// Picks an event by rank from the cumulative distribution of the events.
+/// @param cdf Cumulative probability of every event, in rank order.
+/// @param count Number of events.
+/// @return Rank of the event picked, from 0.
+static unsigned int pick_event(const double* cdf, unsigned int count) {
+  double u = uniform();
+  unsigned int low = 0, high = count - 1;
+  while (low < high) {
+    unsigned int mid = low + (high - low) / 2;
+    if (cdf[mid] < u)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  return low;
+}
+
+/// Picks the number of seats of a RESERVE, geometrically distributed with the given mean.
+static size_t pick_seats(double mean, size_t max) {
+  size_t seats = 1;
+  double p = mean > 1.0 ? 1.0 / mean : 1.0;
+  while (seats < max && uniform() >= p) seats++;
+  return seats;
+}
+
+/// Writes a job file for a workload.
+/// @param out File to write to.
+/// @param workload Parameters of the file.
+/// @return 0 if the file was written, 1 otherwise.
+static int generate(FILE* out, const struct Workload* workload) {
+  double* cdf = malloc(workload->events * sizeof(double));
+  if (cdf == NULL) return 1;
+
+  double total = 0.0;
+  for (unsigned int i = 0; i < workload->events; i++) {
+    total += 1.0 / pow((double)(i + 1), workload->skew);
+    cdf[i] = total;
+  }
+  for (unsigned int i = 0; i < workload->events; i++) cdf[i] /= total;
+
+  srandom(workload->seed);
+  for (unsigned int i = 0; i < workload->events; i++)
+    fprintf(out, "CREATE %u %zu %zu\n", workload->first_event + i, workload->rows, workload->cols);
+
+  size_t max_seats = workload->rows * workload->cols;
+  if (max_seats > MAX_RESERVATION_SIZE - 1) max_seats = MAX_RESERVATION_SIZE - 1;
+
+  for (unsigned int i = 0; i < workload->commands; i++) {
+    unsigned int event_id = workload->first_event + pick_event(cdf, workload->events);
+    double kind = uniform();
+
+    if ((kind -= workload->show_ratio) < 0) {
+      fprintf(out, "SHOW %u\n", event_id);
+    } else if ((kind -= workload->list_ratio) < 0) {
+      fprintf(out, "LIST\n");
+    } else if ((kind -= workload->wait_ratio) < 0) {
+      fprintf(out, "WAIT %u\n", workload->wait_ms);
+    } else if ((kind -= workload->barrier_ratio) < 0) {
+      fprintf(out, "BARRIER\n");
+    } else {
+      // Seats next to each other from a random one on, wrapping around, so no seat repeats.
+      size_t seats = pick_seats(workload->seats_mean, max_seats);
+      size_t first = (size_t)random() % (workload->rows * workload->cols);
+      fprintf(out, "RESERVE %u [", event_id);
+      for (size_t j = 0; j < seats; j++) {
+        size_t seat = (first + j) % (workload->rows * workload->cols);
+        fprintf(out, "%s(%zu,%zu)", j ? " " : "", seat / workload->cols + 1, seat % workload->cols + 1);
+      }
+      fprintf(out, "]\n");
+    }
+  }
+
+  free(cdf);
+  return ferror(out) != 0;
+}
+
+/// Usage: bench/jobgen [options] > file.jobs
+/// Writes a synthetic job file to stdout, the same one for the same options.
+int main(int argc, char* argv[]) {
+  struct Workload workload = {
+      .events = 16,
+      .rows = 20,
+      .cols = 20,
+      .commands = 10000,
+      .seats_mean = 4.0,
+      .skew = 1.0,
+      .show_ratio = 0.05,
+      .list_ratio = 0.01,
+      .wait_ratio = 0.0,
+      .barrier_ratio = 0.0,
+      .wait_ms = 1,
+      .first_event = 1,
+      .seed = 1,
+  };
+
+  int opt;
+  while ((opt = getopt(argc, argv, "e:r:c:n:m:k:S:L:W:B:d:f:s:")) != -1) {
+    switch (opt) {
+      case 'e':
+        workload.events = (unsigned int)strtoul(optarg, NULL, 10);
+        break;
+      case 'r':
+        workload.rows = strtoul(optarg, NULL, 10);
+        break;
+      case 'c':
+        workload.cols = strtoul(optarg, NULL, 10);
+        break;
+      case 'n':
+        workload.commands = (unsigned int)strtoul(optarg, NULL, 10);
+        break;
+      case 'm':
+        workload.seats_mean = strtod(optarg, NULL);
+        break;
+      case 'k':
+        workload.skew = strtod(optarg, NULL);
+        break;
+      case 'S':
+        workload.show_ratio = strtod(optarg, NULL);
+        break;
+      case 'L':
+        workload.list_ratio = strtod(optarg, NULL);
+        break;
+      case 'W':
+        workload.wait_ratio = strtod(optarg, NULL);
+        break;
+      case 'B':
+        workload.barrier_ratio = strtod(optarg, NULL);
+        break;
+      case 'd':
+        workload.wait_ms = (unsigned int)strtoul(optarg, NULL, 10);
+        break;
+      case 'f':
+        workload.first_event = (unsigned int)strtoul(optarg, NULL, 10);
+        break;
+      case 's':
+        workload.seed = (unsigned int)strtoul(optarg, NULL, 10);
+        break;
+      default:
+        fprintf(stderr,
+                "Usage: %s [-e events] [-r rows] [-c cols] [-n commands] [-m mean seats per reserve] [-k zipf skew]\n"
+                "       [-S show ratio] [-L list ratio] [-W wait ratio] [-B barrier ratio] [-d wait ms]\n"
+                "       [-f first event id] [-s seed]\n",
+                argv[0]);
+        return 1;
+    }
+  }
+
+  if (workload.events == 0 || workload.rows == 0 || workload.cols == 0) {
+    fprintf(stderr, "Events, rows and columns must be positive\n");
+    return 1;
+  }
+
+  if (generate(stdout, &workload) != 0) {
+    fprintf(stderr, "Failed to write job file\n");
+    return 1;
+  }
+  return 0;
+}
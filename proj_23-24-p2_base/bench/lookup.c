@@ -0,0 +1,70 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "server/eventlist.h"
+
+#define LOOKUPS 1000000
+
+/// Returns the current monotonic time in nanoseconds.
+static double now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+/// Fills a list with the given number of events, ids 1..num_events.
+/// @return Newly created event list, NULL on failure.
+static struct EventList* fill_list(unsigned int num_events) {
+  struct EventList* list = create_list();
+  if (!list) return NULL;
+
+  for (unsigned int id = 1; id <= num_events; id++) {
+    struct Event* event = create_event(list, id, 0, 0);
+    if (!event || append_to_list(list, event) != 0) {
+      free_list(list);
+      return NULL;
+    }
+  }
+  return list;
+}
+
+int main() {
+  printf("%10s %16s %16s\n", "events", "index ns/op", "scan ns/op");
+
+  for (unsigned int num_events = 10; num_events <= 1000000; num_events *= 10) {
+    struct EventList* list = fill_list(num_events);
+    if (!list) {
+      fprintf(stderr, "Failed to create list\n");
+      return 1;
+    }
+
+    unsigned int seed = 42;
+    size_t found = 0;
+    double start = now_ns();
+    for (int i = 0; i < LOOKUPS; i++) {
+      unsigned int id = (unsigned int)rand_r(&seed) % num_events + 1;
+      found += lookup_event(list, id) != NULL;
+    }
+    double index_ns = (now_ns() - start) / LOOKUPS;
+
+    // The linear scan is only sampled, it gets too slow to run in full on large lists.
+    int scans = num_events > 10000 ? 100 : 10000;
+    start = now_ns();
+    for (int i = 0; i < scans; i++) {
+      unsigned int id = (unsigned int)rand_r(&seed) % num_events + 1;
+      found += get_event(list, id, list->head, list->tail) != NULL;
+    }
+    double scan_ns = (now_ns() - start) / scans;
+
+    if (found != (size_t)LOOKUPS + (size_t)scans) {
+      fprintf(stderr, "Lookup missed an event\n");
+      return 1;
+    }
+
+    printf("%10u %16.1f %16.1f\n", num_events, index_ns, scan_ns);
+    free_list(list);
+  }
+
+  return 0;
+}
@@ -0,0 +1,307 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "client/api.h"
+#include "client/parser.h"
+#include "common/constants.h"
+
+#define NUM_OPS 4  // CREATE, RESERVE, SHOW and LIST.
+
+static const char* op_names[NUM_OPS] = {"create", "reserve", "show", "list"};
+
+// Latencies of every request of one kind, in microseconds.
+struct Samples {
+  double* values;
+  size_t count, capacity;
+  size_t failures;
+};
+
+/// Returns the current monotonic time in microseconds.
+static double now_us() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1e6 + (double)ts.tv_nsec / 1e3;
+}
+
+/// Records the latency of a request.
+/// @return 0 if it was recorded, 1 if memory ran out.
+static int record(struct Samples* samples, double latency_us, int failed) {
+  if (samples->count == samples->capacity) {
+    size_t capacity = samples->capacity == 0 ? 1024 : samples->capacity * 2;
+    double* values = realloc(samples->values, capacity * sizeof(double));
+    if (values == NULL) return 1;
+    samples->values = values;
+    samples->capacity = capacity;
+  }
+  samples->values[samples->count++] = latency_us;
+  samples->failures += failed != 0;
+  return 0;
+}
+
+static int compare_doubles(const void* a, const void* b) {
+  double x = *(const double*)a, y = *(const double*)b;
+  return (x > y) - (x < y);
+}
+
+// A request in flight, with when it was sent. A batch holds the kind and result of each of its operations.
+struct InFlight {
+  int ticket;
+  int op;
+  double start_us;
+  size_t num_ops;  // Operations of a batch, 0 for any other request.
+  int ops[MAX_BATCH_OPERATIONS];
+  int results[MAX_BATCH_OPERATIONS];
+};
+
+static struct Samples latencies[NUM_OPS];  // Indexed by kind of request.
+static size_t max_in_flight = 1;
+
+// Requests in flight, oldest first.
+static struct InFlight in_flight[EMS_MAX_IN_FLIGHT];
+static size_t oldest = 0, num_in_flight = 0;
+
+// CREATEs and RESERVEs not sent yet, with -b, and the rows and columns of the RESERVEs.
+static struct EmsOperation batch[MAX_BATCH_OPERATIONS];
+static size_t batch_seats[2 * MAX_BATCH_SEATS];
+static size_t batch_ops = 0, batch_size = BATCH_HEADER_SIZE, batch_seats_used = 0;
+
+/// Records the latency of a request, exiting if memory ran out.
+static void record_or_exit(int op, double latency_us, int failed) {
+  if (record(&latencies[op], latency_us, failed) != 0) {
+    fprintf(stderr, "Failed to record latency\n");
+    exit(1);
+  }
+}
+
+/// Completes the oldest request in flight and records its latency, once for each operation of a batch.
+static void complete_oldest() {
+  struct InFlight* request = &in_flight[oldest];
+  int failed = ems_complete(request->ticket);
+  double latency_us = now_us() - request->start_us;
+  oldest = (oldest + 1) % EMS_MAX_IN_FLIGHT;
+  num_in_flight--;
+
+  if (request->num_ops == 0) record_or_exit(request->op, latency_us, failed);
+  for (size_t i = 0; i < request->num_ops; i++) {
+    record_or_exit(request->ops[i], latency_us, failed || request->results[i]);
+  }
+}
+
+/// Gets where to keep track of the next request sent.
+static struct InFlight* next_request() { return &in_flight[(oldest + num_in_flight) % EMS_MAX_IN_FLIGHT]; }
+
+/// Keeps track of a request just sent from next_request, completing the oldest ones while too many are in flight.
+/// @param ticket Ticket of the request, -1 if it was not sent, which fails it.
+static void track(struct InFlight* request, int ticket, double start_us) {
+  if (ticket < 0) {
+    if (request->num_ops == 0) record_or_exit(request->op, 0, 1);
+    for (size_t i = 0; i < request->num_ops; i++) record_or_exit(request->ops[i], 0, 1);
+    return;
+  }
+  request->ticket = ticket;
+  request->start_us = start_us;
+  num_in_flight++;
+  while (num_in_flight >= max_in_flight) complete_oldest();
+}
+
+/// Keeps track of a request just sent that is not a batch.
+static void track_single(int op, int ticket, double start_us) {
+  struct InFlight* request = next_request();
+  request->op = op;
+  request->num_ops = 0;
+  track(request, ticket, start_us);
+}
+
+/// Sends the CREATEs and RESERVEs read since the last request in one batch request, if there are any.
+static void send_batch() {
+  if (batch_ops == 0) return;
+
+  struct InFlight* request = next_request();
+  request->num_ops = batch_ops;
+  for (size_t i = 0; i < batch_ops; i++) request->ops[i] = batch[i].op_code == '3' ? 0 : 1;
+  double start_us = now_us();
+  int ticket = ems_batch_async(batch, batch_ops, request->results);
+  batch_ops = 0;
+  batch_size = BATCH_HEADER_SIZE;
+  batch_seats_used = 0;
+  track(request, ticket, start_us);
+}
+
+/// Adds a CREATE or RESERVE to the batch like the client does, sending the batch first if it does not fit in it.
+static void add_to_batch(struct EmsOperation op) {
+  size_t size = ems_batch_operation_size(&op);
+  if (BATCH_HEADER_SIZE + size > MAX_BATCH_SIZE) {
+    send_batch();
+    double start_us = now_us();
+    track_single(1, ems_reserve_async(op.event_id, op.num_seats, op.xs, op.ys), start_us);
+    return;
+  }
+  size_t num_seats = op.op_code == '4' ? op.num_seats : 0;
+  if (batch_ops == MAX_BATCH_OPERATIONS || batch_size + size > MAX_BATCH_SIZE ||
+      batch_seats_used / 2 + num_seats > MAX_BATCH_SEATS)
+    send_batch();
+
+  if (op.op_code == '4') {
+    memcpy(batch_seats + batch_seats_used, op.xs, sizeof(size_t) * op.num_seats);
+    memcpy(batch_seats + batch_seats_used + op.num_seats, op.ys, sizeof(size_t) * op.num_seats);
+    op.xs = batch_seats + batch_seats_used;
+    op.ys = op.xs + op.num_seats;
+    batch_seats_used += 2 * op.num_seats;
+  }
+  batch[batch_ops++] = op;
+  batch_size += size;
+}
+
+/// Returns the value below which the given fraction of the sorted samples fall.
+static double percentile(const struct Samples* samples, double fraction) {
+  size_t index = (size_t)(fraction * (double)(samples->count - 1) + 0.5);
+  return samples->values[index];
+}
+
+/// Usage: bench/replay [-m] [-b] [-n <requests in flight>] <request pipe path> <response pipe path> <server pipe path>
+///                     <.jobs file path>
+/// Runs a job file against the server like the client does, timing every request, and prints ops/s and latency
+/// percentiles per kind of request. SHOW and LIST output is discarded.
+/// With -m, the session moves to shared memory first, which needs the server path to be its socket.
+/// With -n, that many requests are kept in flight, and each is timed from when it is sent to when it completes.
+/// With -b, consecutive CREATEs and RESERVEs go in batch requests like the client sends, each timed like its batch.
+int main(int argc, char* argv[]) {
+  int shared_memory = 0, batching = 0, invalid = 0, opt;
+  while ((opt = getopt(argc, argv, "mbn:")) != -1) {
+    if (opt == 'm') {
+      shared_memory = 1;
+    } else if (opt == 'b') {
+      batching = 1;
+    } else if (opt == 'n') {
+      max_in_flight = strtoul(optarg, NULL, 10);
+      invalid |= max_in_flight == 0 || max_in_flight > EMS_MAX_IN_FLIGHT;
+    } else {
+      invalid = 1;
+    }
+  }
+
+  if (argc - optind < 4 || invalid) {
+    fprintf(stderr,
+            "Usage: %s [-m] [-b] [-n <requests in flight>] <request pipe path> <response pipe path> "
+            "<server pipe path> <.jobs file path>\n",
+            argv[0]);
+    return 1;
+  }
+  char** args = argv + optind;
+
+  int in_fd = open(args[3], O_RDONLY);
+  int out_fd = open("/dev/null", O_WRONLY);
+  if (in_fd == -1 || out_fd == -1) {
+    fprintf(stderr, "Failed to open %s\n", in_fd == -1 ? args[3] : "/dev/null");
+    return 1;
+  }
+
+  if (ems_setup(args[0], args[1], args[2])) {
+    fprintf(stderr, "Failed to set up EMS\n");
+    return 1;
+  }
+
+  if (shared_memory && ems_use_shared_memory()) {
+    fprintf(stderr, "Failed to move to shared memory\n");
+    return 1;
+  }
+
+  double start_us = now_us();
+  int done = 0;
+  while (!done) {
+    unsigned int event_id, delay;
+    size_t num_rows, num_columns, num_coords;
+    size_t xs[MAX_RESERVATION_SIZE], ys[MAX_RESERVATION_SIZE];
+    int op = -1, ticket = -1;
+    double op_start_us = 0;
+    struct EmsOperation batched = {0};
+
+    switch (get_next(in_fd)) {
+      case CMD_CREATE:
+        if (parse_create(in_fd, &event_id, &num_rows, &num_columns) != 0) break;
+        if (batching) {
+          batched = (struct EmsOperation){.op_code = '3', .event_id = event_id, .num_rows = num_rows,
+                                          .num_cols = num_columns};
+          break;
+        }
+        op = 0;
+        op_start_us = now_us();
+        ticket = ems_create_async(event_id, num_rows, num_columns);
+        break;
+
+      case CMD_RESERVE:
+        num_coords = parse_reserve(in_fd, MAX_RESERVATION_SIZE, &event_id, xs, ys);
+        if (num_coords == 0) break;
+        if (batching) {
+          batched = (struct EmsOperation){.op_code = '4', .event_id = event_id, .num_seats = num_coords, .xs = xs,
+                                          .ys = ys};
+          break;
+        }
+        op = 1;
+        op_start_us = now_us();
+        ticket = ems_reserve_async(event_id, num_coords, xs, ys);
+        break;
+
+      case CMD_SHOW:
+        if (parse_show(in_fd, &event_id) != 0) break;
+        send_batch();
+        op = 2;
+        op_start_us = now_us();
+        ticket = ems_show_async(out_fd, event_id);
+        break;
+
+      case CMD_LIST_EVENTS:
+        send_batch();
+        op = 3;
+        op_start_us = now_us();
+        ticket = ems_list_events_async(out_fd);
+        break;
+
+      case CMD_WAIT:
+        send_batch();
+        while (num_in_flight > 0) complete_oldest();
+        if (parse_wait(in_fd, &delay, NULL) == 0 && delay > 0) {
+          struct timespec ts = {delay / 1000, (delay % 1000) * 1000000};
+          nanosleep(&ts, NULL);
+        }
+        break;
+
+      case CMD_INVALID:
+      case CMD_HELP:
+      case CMD_EMPTY:
+        break;
+
+      case EOC:
+        send_batch();
+        while (num_in_flight > 0) complete_oldest();
+        done = 1;
+        break;
+    }
+
+    if (batched.op_code != 0) add_to_batch(batched);
+    if (op >= 0) track_single(op, ticket, op_start_us);
+  }
+  double elapsed_us = now_us() - start_us;
+  ems_quit();
+
+  size_t total = 0;
+  printf("%-8s %8s %8s %10s %10s %10s %10s\n", "op", "count", "failed", "p50 us", "p90 us", "p99 us", "max us");
+  for (int op = 0; op < NUM_OPS; op++) {
+    struct Samples* s = &latencies[op];
+    total += s->count;
+    if (s->count == 0) continue;
+    qsort(s->values, s->count, sizeof(double), compare_doubles);
+    printf("%-8s %8zu %8zu %10.1f %10.1f %10.1f %10.1f\n", op_names[op], s->count, s->failures, percentile(s, 0.5),
+           percentile(s, 0.9), percentile(s, 0.99), s->values[s->count - 1]);
+    free(s->values);
+  }
+  printf("%zu requests in %.3f s: %.0f ops/s\n", total, elapsed_us / 1e6, (double)total / (elapsed_us / 1e6));
+
+  close(in_fd);
+  close(out_fd);
+  return 0;
+}
@@ -0,0 +1,54 @@
+#!/bin/sh
+# Runs the same generated workload against the P1 ems and the P2 server, printing ops/s and latencies.
+# Usage: bench/run.sh [clients] [commands per client] [extra jobgen options...]
+# Run from proj_23-24-p2_base, after building bench/jobgen, bench/replay, server/ems and the P1 ems.
+
+CLIENTS=${1:-4}
+COMMANDS=${2:-2000}
+shift 2 2>/dev/null
+P1_EMS=../SO23-24-P1-Base/p1_base/ems
+DIR=tmp/bench
+
+rm -rf "$DIR" && mkdir -p "$DIR/p1" || exit 1
+
+# Every client gets its own events and seed, so the files neither collide nor repeat each other.
+i=1
+while [ "$i" -le "$CLIENTS" ]; do
+  ./bench/jobgen -n "$COMMANDS" -f $(((i - 1) * 1000 + 1)) -s "$i" "$@" > "$DIR/client$i.jobs" || exit 1
+  cp "$DIR/client$i.jobs" "$DIR/p1/client$i.jobs"
+  i=$((i + 1))
+done
+TOTAL=$((CLIENTS * COMMANDS))
+
+now_ms() { date +%s%3N; }
+
+echo "== P1: $CLIENTS job files, one process each, 4 threads, no access delay"
+start=$(now_ms)
+"$P1_EMS" "$DIR/p1" "$CLIENTS" 4 0 > "$DIR/p1.log" 2>&1 || echo "P1 ems failed, see $DIR/p1.log"
+elapsed=$(($(now_ms) - start))
+echo "$TOTAL commands in $elapsed ms: $((TOTAL * 1000 / (elapsed > 0 ? elapsed : 1))) ops/s"
+
+echo "== P2: $CLIENTS clients, no access delay"
+./server/ems "$DIR/server" 0 > "$DIR/server.log" 2>&1 &
+SERVER=$!
+while [ ! -p "$DIR/server" ]; do sleep 0.1; done
+
+start=$(now_ms)
+PIDS=
+i=1
+while [ "$i" -le "$CLIENTS" ]; do
+  ./bench/replay "$DIR/req$i" "$DIR/resp$i" "$DIR/server" "$DIR/client$i.jobs" > "$DIR/replay$i.log" 2>&1 &
+  PIDS="$PIDS $!"
+  i=$((i + 1))
+done
+for pid in $PIDS; do wait "$pid"; done
+elapsed=$(($(now_ms) - start))
+kill "$SERVER"
+
+echo "$TOTAL commands in $elapsed ms: $((TOTAL * 1000 / (elapsed > 0 ? elapsed : 1))) ops/s"
+i=1
+while [ "$i" -le "$CLIENTS" ]; do
+  echo "-- client $i"
+  cat "$DIR/replay$i.log"
+  i=$((i + 1))
+done
@@ -0,0 +1,109 @@
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "server/eventlist.h"
+#include "server/operations.h"
+
+// Dimensions CREATE must refuse, as some size derived from them would overflow.
+static const struct {
+  size_t rows, cols;
+  const char* what;
+} oversized[] = {
+    {((size_t)1 << 61) + 1, 1, "tile table wrapping around"},
+    {SIZE_MAX, SIZE_MAX, "seat count wrapping around"},
+    {(size_t)1 << 32, (size_t)1 << 32, "SHOW response wrapping around"},
+    {1, ((size_t)UINT_MAX + 1) * SEAT_TILE_COLS, "tile index past an unsigned int"},
+};
+
+#define LOG_PATH "/tmp/ems_bench_sparse.log"
+#define VENUE_SIDE 10000      // Rows and columns of the venue shown, stored sparsely.
+#define MAX_SHOW_GROWTH_MB 64  // Peak memory a SHOW of it may add, far below its 400 MB of seats.
+
+/// Gets the peak resident memory of the process so far.
+/// @return Peak resident memory in MB.
+static long peak_mb() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss / 1024;
+}
+
+/// Shows a venue with its corners reserved and checks the response, then checks the memory the SHOW took.
+/// @return 0 if the response is right and the SHOW stayed within MAX_SHOW_GROWTH_MB, 1 otherwise.
+static int show_venue(unsigned int id) {
+  size_t xs[] = {1, VENUE_SIDE}, ys[] = {1, VENUE_SIDE};
+  if (ems_create(id, VENUE_SIDE, VENUE_SIDE) != 0 || ems_reserve(id, 2, xs, ys) != 0) return 1;
+
+  FILE* out = tmpfile();
+  long before = peak_mb();
+  if (!out || ems_show(fileno(out), id) != 0) return 1;
+  long growth = peak_mb() - before;
+
+  // Header, then the seats row by row: the first and the last seat hold reservation 1.
+  int ret;
+  size_t rows, cols;
+  unsigned int first, last;
+  off_t last_offset = (off_t)(sizeof(int) + sizeof(size_t) * 2 + sizeof(unsigned int) * (VENUE_SIDE * VENUE_SIDE - 1));
+  int wrong = pread(fileno(out), &ret, sizeof(int), 0) != sizeof(int) ||
+              pread(fileno(out), &rows, sizeof(size_t), sizeof(int)) != sizeof(size_t) ||
+              pread(fileno(out), &cols, sizeof(size_t), sizeof(int) + sizeof(size_t)) != sizeof(size_t) ||
+              pread(fileno(out), &first, sizeof(int), sizeof(int) + sizeof(size_t) * 2) != sizeof(int) ||
+              pread(fileno(out), &last, sizeof(int), last_offset) != sizeof(int) ||
+              lseek(fileno(out), 0, SEEK_END) != last_offset + (off_t)sizeof(unsigned int);
+  wrong = wrong || ret != 0 || rows != VENUE_SIDE || cols != VENUE_SIDE || first != 1 || last != 1;
+  fclose(out);
+
+  printf("%-32s %s, %ld MB more at peak\n", "SHOW of a 10k x 10k venue", wrong ? "WRONG" : "right", growth);
+  return wrong || growth > MAX_SHOW_GROWTH_MB;
+}
+
+/// Checks that the seats of a wide venue came back from the log as reserved, each in its own column.
+/// @note Column cols cut to 32 bits is column SEAT_TILE_COLS, which must still be free.
+/// @return 0 if the seats are right, 1 otherwise.
+static int check_replayed(unsigned int id, size_t cols) {
+  size_t xs[] = {2}, taken[] = {cols}, free_col[] = {SEAT_TILE_COLS};
+  int right = ems_reserve(id, 1, xs, taken) != 0 && ems_reserve(id, 1, xs, free_col) == 0;
+  printf("%-32s %s\n", "wide venue replayed from log", right ? "right" : "WRONG");
+  return !right;
+}
+
+int main() {
+  unlink(LOG_PATH);
+  if (ems_init(0) != 0 || ems_open_log(LOG_PATH, 0) != 0) {
+    fprintf(stderr, "Failed to initialize EMS\n");
+    return 1;
+  }
+
+  int failures = 0;
+  unsigned int id = 1;
+  for (size_t i = 0; i < sizeof(oversized) / sizeof(oversized[0]); i++, id++) {
+    int refused = ems_create(id, oversized[i].rows, oversized[i].cols) != 0;
+    printf("%-32s %s\n", oversized[i].what, refused ? "refused" : "CREATED");
+    failures += !refused;
+  }
+
+  // Shown before the wide venue below, whose row of tiles would set the peak.
+  failures += show_venue(id++);
+
+  // A sparse venue wider than an unsigned int counts still takes reservations past that column.
+  size_t cols = ((size_t)1 << 32) + SEAT_TILE_COLS, xs[] = {2, 2}, ys[] = {1, cols};
+  int created = ems_create(id, 2, cols) == 0;
+  int reserved = created && ems_reserve(id, 2, xs, ys) == 0;
+  printf("%-32s %s\n", "wide sparse venue", !created ? "NOT CREATED" : reserved ? "reserved" : "NOT RESERVED");
+  failures += !reserved;
+
+  ems_terminate();
+  if (ems_init(0) != 0 || ems_open_log(LOG_PATH, 0) != 0) {
+    fprintf(stderr, "Failed to replay log\n");
+    return 1;
+  }
+  failures += reserved && check_replayed(id, cols);
+
+  ems_terminate();
+  unlink(LOG_PATH);
+  return failures != 0;
+}
@@ -0,0 +1,91 @@
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "common/constants.h"
+#include "server/operations.h"
+
+#define NUM_EVENTS 2000
+#define ROWS 100
+#define COLS 100
+#define CHECKPOINT_PATH "/tmp/ems_bench_startup.img"
+
+/// Returns the current monotonic time in seconds.
+static double now_s() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/// Reserves the first row of every event, the way replaying a log would.
+/// @return 0 if every reservation succeeded, 1 otherwise.
+static int reserve_rows() {
+  size_t xs[MAX_RESERVATION_SIZE], ys[MAX_RESERVATION_SIZE];
+  for (size_t col = 0; col < COLS && col < MAX_RESERVATION_SIZE; col++) {
+    xs[col] = 1;
+    ys[col] = col + 1;
+  }
+
+  for (unsigned int id = 1; id <= NUM_EVENTS; id++) {
+    if (ems_reserve(id, COLS < MAX_RESERVATION_SIZE ? COLS : MAX_RESERVATION_SIZE, xs, ys) != 0) return 1;
+  }
+  return 0;
+}
+
+/// Shows every event, which touches all their seats.
+/// @return 0 if every event was shown, 1 otherwise.
+static int show_all(int out_fd) {
+  for (unsigned int id = 1; id <= NUM_EVENTS; id++) {
+    if (ems_show(out_fd, id) != 0) return 1;
+  }
+  return 0;
+}
+
+int main() {
+  FILE* null = fopen("/dev/null", "w");
+  if (!null || ems_init(0) != 0) {
+    fprintf(stderr, "Failed to initialize EMS\n");
+    return 1;
+  }
+
+  double start = now_s();
+  for (unsigned int id = 1; id <= NUM_EVENTS; id++) {
+    if (ems_create(id, ROWS, COLS) != 0) {
+      fprintf(stderr, "Failed to create event %u\n", id);
+      return 1;
+    }
+  }
+  if (reserve_rows() != 0) {
+    fprintf(stderr, "Failed to reserve seats\n");
+    return 1;
+  }
+  double rebuild_s = now_s() - start;
+
+  start = now_s();
+  if (ems_checkpoint(CHECKPOINT_PATH) != 0) return 1;
+  double checkpoint_s = now_s() - start;
+  ems_terminate();
+
+  if (ems_init(0) != 0) return 1;
+  start = now_s();
+  if (ems_load_checkpoint(CHECKPOINT_PATH) != 0) return 1;
+  double load_s = now_s() - start;
+
+  start = now_s();
+  if (show_all(fileno(null)) != 0) {
+    fprintf(stderr, "Failed to show events\n");
+    return 1;
+  }
+  double show_s = now_s() - start;
+
+  ems_terminate();
+  unlink(CHECKPOINT_PATH);
+  fclose(null);
+
+  printf("%d events of %dx%d, one row reserved in each\n", NUM_EVENTS, ROWS, COLS);
+  printf("rebuild by replaying operations: %8.3f s\n", rebuild_s);
+  printf("write checkpoint:                %8.3f s\n", checkpoint_s);
+  printf("load checkpoint:                 %8.3f s\n", load_s);
+  printf("first SHOW of every event:       %8.3f s\n", show_s);
+  return 0;
+}
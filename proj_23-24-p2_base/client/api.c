@@ -1,20 +1,290 @@
+#define _GNU_SOURCE  // memfd_create and file seals are not part of POSIX.1-2008
 #include "api.h"
 #include "../common/constants.h"
+#include "../common/frame.h"
 #include "../common/io.h"
+#include "../common/ring.h"
 
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/un.h>
 #include <unistd.h>
 
 int fd_req, fd_resp;
 const char* req_path;
 const char* resp_path;
 int session_id;
+static int server_socket = -1;               // Socket to the server, -1 when connected through pipes.
+static struct SharedSession* shared = NULL;  // Rings of the session, once it moved to shared memory.
+
+// Bytes of requests sent and not answered yet past which the client reads responses before sending more. Well
+// within a pipe's 64 KiB, and enough for three RESERVEs of the largest size.
+#define MAX_UNANSWERED_BYTES 16384
+
+// A request sent without waiting for its response, until its ticket is completed.
+struct Pending {
+  int ticket;
+  char op_code;
+  int out_fd;   // Where a SHOW or LIST prints its response.
+  int* results;  // Where a batch stores the result of each operation, and how many there are.
+  size_t num_results;
+  size_t size;  // Bytes of the request.
+  int answered;
+  int result;
+  int in_use;
+};
+
+static struct Pending pending[EMS_MAX_IN_FLIGHT];  // Indexed by ticket, modulo its size.
+static unsigned int next_ticket = 0;                // Ticket of the next request sent.
+static unsigned int next_response = 0;              // Ticket of the oldest request waiting for its response.
+static size_t unanswered_bytes = 0;                 // Bytes of the requests waiting for their responses.
+
+/// Sends a request to the server as a frame, through the request ring once the session moved to shared memory.
+/// @note The header and payload go in one writev, so the payload is neither copied nor sent in a write of its own.
+/// @param payload Payload of the frame.
+/// @param size Number of bytes of the payload.
+/// @return Number of bytes of the whole frame, 0 if it could not all be sent.
+static size_t send_frame(const char* payload, size_t size) {
+  char header[FRAME_HEADER_MAX_SIZE];
+  size_t header_size = frame_header(header, size);
+  if (shared != NULL) {
+    if (ring_write(&shared->requests, header, header_size, server_socket) != 0 ||
+        ring_write(&shared->requests, payload, size, server_socket) != 0) {
+      return 0;
+    }
+    return header_size + size;
+  }
+
+  // A signal may interrupt the write after part of the frame went out, so the rest is written after it.
+  struct iovec iov[2] = {{.iov_base = header, .iov_len = header_size}, {.iov_base = (void*)payload, .iov_len = size}};
+  struct iovec* next = iov;
+  int count = 2;
+  while (count > 0) {
+    ssize_t written = writev(fd_req, next, count);
+    if (written < 0 && errno == EINTR) continue;
+    if (written <= 0) return 0;
+    for (; count > 0 && (size_t)written >= next->iov_len; next++, count--) {
+      written -= (ssize_t)next->iov_len;
+    }
+    if (count > 0) {
+      next->iov_base = (char*)next->iov_base + written;
+      next->iov_len -= (size_t)written;
+    }
+  }
+  return header_size + size;
+}
+
+/// Writes a number to a frame payload.
+/// @return Where the payload goes on.
+static char* put_number(char* out, uint64_t value) { return out + varint_put(out, value); }
+
+/// Starts a frame payload with the op code and the session id.
+/// @return Where the payload goes on.
+static char* start_payload(char* out, char op_code) {
+  *out = op_code;
+  return put_number(out + 1, (uint64_t)session_id);
+}
+
+/// Writes the arguments of a CREATE or RESERVE to a frame payload.
+/// @return Where the payload goes on.
+static char* put_operation(char* out, const struct EmsOperation* op) {
+  out = put_number(out, op->event_id);
+  if (op->op_code == '3') {
+    out = put_number(out, op->num_rows);
+    return put_number(out, op->num_cols);
+  }
+  out = put_number(out, op->num_seats);
+  for (size_t i = 0; i < op->num_seats; i++) {
+    out = put_number(out, op->xs[i]);
+    out = put_number(out, op->ys[i]);
+  }
+  return out;
+}
+
+/// Receives part of a response, through the response ring once the session moved to shared memory.
+/// @return 0 if every byte was received, 1 otherwise.
+static int receive(void* buf, size_t len) {
+  if (shared != NULL)
+    return ring_read(&shared->responses, buf, len, server_socket);
+  return read_full(fd_resp, buf, len);
+}
+
+/// Reads the rest of the response to a SHOW and prints the event.
+/// @return 0 if the event was printed, 1 otherwise.
+static int receive_show(int out_fd) {
+  int ret;
+  size_t num_rows, num_cols;
+  if (receive(&ret, sizeof(int)) != 0)
+    return 1;
+  if (ret != 0)
+    return ret;
+
+  if (receive(&num_rows, sizeof(size_t)) != 0 || receive(&num_cols, sizeof(size_t)) != 0)
+    return 1;
+
+  // Rows are read and printed one at a time, so a huge venue never has to fit in memory at once.
+  if (num_cols > SIZE_MAX / sizeof(unsigned int))
+    return 1;
+  unsigned int* row = malloc(num_cols ? num_cols * sizeof(unsigned int) : 1);
+  if (row == NULL)
+    return 1;
+
+  struct Writer writer;
+  writer_init(&writer, out_fd);
+  for (size_t i = 0; i < num_rows && ret == 0; i++) {
+    ret = receive(row, num_cols * sizeof(unsigned int));
+    if (ret == 0)
+      writer_row(&writer, row, num_cols);
+  }
+  writer_flush(&writer);
+  free(row);
+  return ret;
+}
+
+/// Reads the response to a LIST and prints the events.
+/// @return 0 if the events were printed, 1 otherwise.
+static int receive_list(int out_fd) {
+  int ret;
+  size_t num_events;
+  if (receive(&ret, sizeof(int)) != 0)
+    return 1;
+  if (ret != 0)
+    return ret;
+
+  if (receive(&num_events, sizeof(size_t)) != 0)
+    return 1;
+  if (!num_events)
+    print_str(out_fd, "No events\n");
+  else{
+    unsigned int event_ids[num_events];
+    if (receive(event_ids, sizeof(unsigned int)*num_events) != 0)
+      return 1;
+    struct Writer writer;
+    writer_init(&writer, out_fd);
+    for (size_t i = 0; i<num_events; i++){
+      writer_str(&writer, "Event: ");
+      writer_uint(&writer, event_ids[i]);
+      writer_str(&writer, "\n");
+    }
+    writer_flush(&writer);
+  }
+  return ret;
+}
+
+/// Reads the response to the oldest request still waiting for one, printing it for a SHOW or LIST.
+static void read_response() {
+  struct Pending* request = &pending[next_response % EMS_MAX_IN_FLIGHT];
+  int ret;
+  switch (request->op_code) {
+    case '5':
+      request->result = receive_show(request->out_fd);
+      break;
+    case '6':
+      request->result = receive_list(request->out_fd);
+      break;
+    case '8':
+      request->result = receive(request->results, sizeof(int) * request->num_results) != 0;
+      for (size_t i = 0; i < request->num_results && request->result != 0; i++)
+        request->results[i] = 1;
+      break;
+    default:
+      request->result = receive(&ret, sizeof(int)) != 0 ? 1 : ret;
+  }
+  request->answered = 1;
+  unanswered_bytes -= request->size;
+  next_response++;
+}
+
+/// Reads the responses to every request sent so far.
+static void read_responses() {
+  while (next_response != next_ticket)
+    read_response();
+}
+
+/// Sends a request without waiting for its response.
+/// @param payload Payload of the request's frame.
+/// @param size Number of bytes of the payload.
+/// @param out_fd File descriptor a SHOW or LIST prints its response to.
+/// @param results Where a batch stores the result of each operation.
+/// @param num_results Number of operations of a batch.
+/// @return Ticket of the request, -1 if too many are in flight or it could not be sent.
+static int send_async(const char* payload, size_t size, int out_fd, int* results, size_t num_results) {
+  unsigned int ticket = next_ticket;
+  struct Pending* request = &pending[ticket % EMS_MAX_IN_FLIGHT];
+  if (request->in_use) {
+    fprintf(stderr, "Too many requests in flight.\n");
+    return -1;
+  }
+  if (FRAME_HEADER_MAX_SIZE + size > MAX_FRAME_SIZE) {
+    fprintf(stderr, "Request too large.\n");
+    return -1;
+  }
+
+  // Requests not answered yet are kept within what the pipe, socket or ring to the server holds. Past that, writing
+  // one could block while the server blocks writing a response nobody reads.
+  while (unanswered_bytes > 0 && unanswered_bytes + FRAME_HEADER_MAX_SIZE + size > MAX_UNANSWERED_BYTES)
+    read_response();
+
+  size = send_frame(payload, size);
+  if (size == 0) {
+    fprintf(stderr, "Error sending request.\n");
+    return -1;
+  }
+  request->ticket = (int)(ticket & INT_MAX);
+  request->op_code = payload[0];
+  request->out_fd = out_fd;
+  request->results = results;
+  request->num_results = num_results;
+  request->size = size;
+  request->answered = 0;
+  request->in_use = 1;
+  unanswered_bytes += size;
+  next_ticket++;
+  return request->ticket;
+}
+
+/// Connects to a server listening on a Unix socket. Requests and responses both go through the socket.
+/// @param socket_path Path to the socket.
+/// @return 0 if the connection was established successfully, 1 otherwise.
+static int setup_socket(char const* socket_path) {
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (strlen(socket_path) >= sizeof(address.sun_path)) {
+    fprintf(stderr, "Socket path too long.\n");
+    return 1;
+  }
+  strcpy(address.sun_path, socket_path);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0 || connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+    fprintf(stderr, "Error connecting to server socket.\n");
+    if (fd >= 0) close(fd);
+    return 1;
+  }
+
+  fd_req = server_socket = fd;
+  if ((fd_resp = dup(fd)) < 0 || read_full(fd_resp, &session_id, sizeof(int)) != 0) {
+    fprintf(stderr, "Error starting session.\n");
+    return 1;
+  }
+  return 0;
+}
 
 int ems_setup(char const* req_pipe_path, char const* resp_pipe_path, char const* server_pipe_path) {
+  struct stat server_stat;
+  if (stat(server_pipe_path, &server_stat) == 0 && S_ISSOCK(server_stat.st_mode))
+    return setup_socket(server_pipe_path);
 
   char msg[(MAX_PIPE_NAME_SIZE*2 + 1) * sizeof(char)];
   int fd_serv;
@@ -55,119 +325,190 @@ int ems_setup(char const* req_pipe_path, char const* resp_pipe_path, char const*
     return 1;
   }
 
-  read(fd_resp, &session_id, sizeof(int));
+  if (read_full(fd_resp, &session_id, sizeof(int)) != 0) {
+    fprintf(stderr, "Error starting session.\n");
+    return 1;
+  }
   return 0;
 }
 
 int ems_quit(void) { 
   
-  char OP_CODE = '2';
-  char msg[sizeof(char) + sizeof(int)];
-  memcpy(msg, &OP_CODE, sizeof(char));
-  memcpy(msg + sizeof(char), &session_id, sizeof(int));
-  write(fd_req, msg, sizeof(char) + sizeof(int));
+  read_responses();
+  char payload[1 + VARINT_MAX_SIZE];
+  int ret = 0;
+  if (send_frame(payload, (size_t)(start_payload(payload, '2') - payload)) == 0) {
+    fprintf(stderr, "Error sending request.\n");
+    ret = 1;
+  }
+  if (shared != NULL) {
+    munmap(shared, sizeof(struct SharedSession));
+    shared = NULL;
+  }
   close(fd_req);
   close(fd_resp);
-  return 0;
+  server_socket = -1;
+  return ret;
 }
 
-int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols) {
+int ems_use_shared_memory(void) {
+  if (server_socket < 0 || shared != NULL) {
+    fprintf(stderr, "Only sessions on the server socket can move to shared memory.\n");
+    return 1;
+  }
+  read_responses();
 
-  char OP_CODE = '3';
-  int ret;
-  char msg[sizeof(char) + sizeof(int) + sizeof(unsigned int) + sizeof(size_t) * 2];
+  // The region has no name, so it goes away with the last process mapping it. Its size is sealed, as the server
+  // only maps regions that can no longer be resized under it.
+  int shm_fd = memfd_create("ems-session", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (shm_fd < 0) {
+    fprintf(stderr, "Error creating shared memory.\n");
+    return 1;
+  }
+
+  struct SharedSession* mapping = MAP_FAILED;
+  if (ftruncate(shm_fd, sizeof(struct SharedSession)) == 0 &&
+      fcntl(shm_fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) == 0)
+    mapping = mmap(NULL, sizeof(struct SharedSession), PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+  if (mapping == MAP_FAILED) {
+    fprintf(stderr, "Error mapping shared memory.\n");
+    close(shm_fd);
+    return 1;
+  }
 
+  // The request carries the region's file descriptor, which the server gets a copy of.
+  char OP_CODE = '7';
+  char msg[sizeof(char) + sizeof(int)];
   memcpy(msg, &OP_CODE, sizeof(char));
   memcpy(msg + sizeof(char), &session_id, sizeof(int));
-  memcpy(msg + sizeof(char) + sizeof(int), &event_id, sizeof(unsigned int));
-  memcpy(msg + sizeof(char) + sizeof(int) + sizeof(unsigned int), &num_rows, sizeof(size_t));
-  memcpy(msg + sizeof(char) + sizeof(int) + sizeof(unsigned int) + sizeof(size_t), &num_cols, sizeof(size_t));
-  write(fd_req, msg, sizeof(char) + sizeof(int) + sizeof(unsigned int) + sizeof(size_t) * 2);
-  read(fd_resp, &ret, sizeof(int));
+  struct iovec iov = {.iov_base = msg, .iov_len = sizeof(msg)};
+  union {
+    char buf[CMSG_SPACE(sizeof(int))];
+    struct cmsghdr align;
+  } control;
+  memset(&control, 0, sizeof(control));
+  struct msghdr request;
+  memset(&request, 0, sizeof(request));
+  request.msg_iov = &iov;
+  request.msg_iovlen = 1;
+  request.msg_control = control.buf;
+  request.msg_controllen = sizeof(control.buf);
+  struct cmsghdr* cmsg = CMSG_FIRSTHDR(&request);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+  memcpy(CMSG_DATA(cmsg), &shm_fd, sizeof(int));
 
-  return ret;
+  int ret = 1;
+  if (sendmsg(server_socket, &request, 0) != (ssize_t)sizeof(msg) || read_full(fd_resp, &ret, sizeof(int)) != 0 ||
+      ret != 0) {
+    fprintf(stderr, "Server did not move the session to shared memory.\n");
+    munmap(mapping, sizeof(struct SharedSession));
+    close(shm_fd);
+    return 1;
+  }
+
+  close(shm_fd);
+  shared = mapping;
+  return 0;
 }
 
-int ems_reserve(unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys) {
+int ems_complete(int ticket) {
+  struct Pending* request = &pending[(unsigned int)ticket % EMS_MAX_IN_FLIGHT];
+  if (ticket < 0 || !request->in_use || request->ticket != ticket) {
+    fprintf(stderr, "No request in flight with ticket %d.\n", ticket);
+    return 1;
+  }
 
-  char OP_CODE = '4';
-  int ret;
-  char msg[sizeof(char) + sizeof(int) + sizeof(unsigned int) + sizeof(size_t)*(num_seats*2+1)];
+  while (!request->answered)
+    read_response();
+  request->in_use = 0;
+  return request->result;
+}
 
-  memcpy(msg, &OP_CODE, sizeof(char));
-  memcpy(msg + sizeof(char), &session_id, sizeof(int));
-  memcpy(msg + sizeof(char) + sizeof(int), &event_id, sizeof(unsigned int));
-  memcpy(msg + sizeof(char) + sizeof(int) + sizeof(unsigned int), &num_seats, sizeof(size_t));
-  memcpy(msg + sizeof(char) + sizeof(int) + sizeof(unsigned int) + sizeof(size_t), xs, sizeof(size_t)*num_seats);
-  memcpy(msg + sizeof(char) + sizeof(int) + sizeof(unsigned int) + sizeof(size_t)*(num_seats+1), ys, sizeof(size_t)*num_seats);
-  write(fd_req, msg, sizeof(char) + sizeof(int) + sizeof(unsigned int) + sizeof(size_t)*(num_seats*2+1));
-  read(fd_resp, &ret, sizeof(int));
+int ems_create_async(unsigned int event_id, size_t num_rows, size_t num_cols) {
+  struct EmsOperation op = {.op_code = '3', .event_id = event_id, .num_rows = num_rows, .num_cols = num_cols};
+  char payload[1 + VARINT_MAX_SIZE * 4];
+  char* end = put_operation(start_payload(payload, '3'), &op);
+  return send_async(payload, (size_t)(end - payload), -1, NULL, 0);
+}
 
-  return ret;
+int ems_reserve_async(unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys) {
+  if (num_seats > MAX_RESERVATION_SIZE) {
+    fprintf(stderr, "Too many seats.\n");
+    return -1;
+  }
+  struct EmsOperation op = {.op_code = '4', .event_id = event_id, .num_seats = num_seats, .xs = xs, .ys = ys};
+  char payload[1 + VARINT_MAX_SIZE * (3 + 2 * MAX_RESERVATION_SIZE)];
+  char* end = put_operation(start_payload(payload, '4'), &op);
+  return send_async(payload, (size_t)(end - payload), -1, NULL, 0);
 }
 
-int ems_show(int out_fd, unsigned int event_id) {
-  char OP_CODE = '5';
-  int ret;
-  size_t num_rows, num_cols;
-  char msg[sizeof(char) + sizeof(int) + sizeof(unsigned int)];
-  
+int ems_show_async(int out_fd, unsigned int event_id) {
+  char payload[1 + VARINT_MAX_SIZE * 2];
+  char* end = put_number(start_payload(payload, '5'), event_id);
+  return send_async(payload, (size_t)(end - payload), out_fd, NULL, 0);
+}
 
-  memcpy(msg, &OP_CODE, sizeof(char));
-  memcpy(msg + sizeof(char), &session_id, sizeof(int));
-  memcpy(msg + sizeof(char) + sizeof(int), &event_id, sizeof(unsigned int));
-  write(fd_req, msg, sizeof(char) + sizeof(int) + sizeof(unsigned int));
+int ems_list_events_async(int out_fd) {
+  char payload[1 + VARINT_MAX_SIZE];
+  char* end = start_payload(payload, '6');
+  return send_async(payload, (size_t)(end - payload), out_fd, NULL, 0);
+}
 
-  read(fd_resp, &ret, sizeof(int));
-  if (ret != 0)
-    return ret;
+size_t ems_batch_operation_size(const struct EmsOperation* op) {
+  size_t size = sizeof(char) + varint_size(op->event_id);
+  if (op->op_code == '3')
+    return size + varint_size(op->num_rows) + varint_size(op->num_cols);
 
-  read(fd_resp, &num_rows, sizeof(size_t));
-  read(fd_resp, &num_cols, sizeof(size_t));
+  size += varint_size(op->num_seats);
+  for (size_t i = 0; i < op->num_seats; i++)
+    size += varint_size(op->xs[i]) + varint_size(op->ys[i]);
+  return size;
+}
 
-  unsigned int seats[num_rows * num_cols];
-  read(fd_resp, seats, num_rows*num_cols*sizeof(unsigned int));
+int ems_batch_async(const struct EmsOperation* ops, size_t num_ops, int* results) {
+  size_t size = BATCH_HEADER_SIZE, num_seats = 0;
+  for (size_t i = 0; i < num_ops; i++) {
+    size += ems_batch_operation_size(&ops[i]);
+    num_seats += ops[i].op_code == '4' ? ops[i].num_seats : 0;
+  }
+  if (num_ops == 0 || num_ops > MAX_BATCH_OPERATIONS || size > MAX_BATCH_SIZE || num_seats > MAX_BATCH_SEATS) {
+    fprintf(stderr, "Batch too large.\n");
+    return -1;
+  }
 
-  for (size_t i = 0; i<num_rows; i++){
-    for (size_t j = 0; j<num_cols; j++){
-      char buffer[16];
-      sprintf(buffer, "%u", seats[i*num_cols + j]);
-      print_str(out_fd, buffer);
-      if (j<num_cols-1)
-        print_str(out_fd, " ");
-    }
-    print_str(out_fd, "\n");
+  // Each operation is laid out like its own request, with the session id left out.
+  char payload[MAX_BATCH_SIZE];
+  char* end = put_number(start_payload(payload, '8'), num_ops);
+  for (size_t i = 0; i < num_ops; i++) {
+    *end++ = ops[i].op_code;
+    end = put_operation(end, &ops[i]);
   }
-  return ret;
+  return send_async(payload, (size_t)(end - payload), -1, results, num_ops);
 }
 
-int ems_list_events(int out_fd) {
-
-  char OP_CODE = '6';
-  char msg[sizeof(char) + sizeof(int)];
-  int ret;
-  size_t num_events;
+int ems_batch(const struct EmsOperation* ops, size_t num_ops, int* results) {
+  int ticket = ems_batch_async(ops, num_ops, results);
+  return ticket < 0 ? 1 : ems_complete(ticket);
+}
 
-  memcpy(msg, &OP_CODE, sizeof(char));
-  memcpy(msg + sizeof(char), &session_id, sizeof(int));
-  write(fd_req, msg, sizeof(char) + sizeof(int));
+int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols) {
+  int ticket = ems_create_async(event_id, num_rows, num_cols);
+  return ticket < 0 ? 1 : ems_complete(ticket);
+}
 
-  read(fd_resp, &ret, sizeof(int));
-  if (ret != 0)
-    return ret;
+int ems_reserve(unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys) {
+  int ticket = ems_reserve_async(event_id, num_seats, xs, ys);
+  return ticket < 0 ? 1 : ems_complete(ticket);
+}
 
-  read(fd_resp, &num_events, sizeof(size_t));
-  if (!num_events)
-    print_str(out_fd, "No events\n");
-  else{
-    unsigned int event_ids[num_events];
-    read(fd_resp, event_ids, sizeof(unsigned int)*num_events);
-    for (size_t i = 0; i<num_events; i++){
-      char buffer[16];
-      sprintf(buffer, "Event: %u\n", event_ids[i]);
-      print_str(out_fd, buffer);
-    }
-  }
+int ems_show(int out_fd, unsigned int event_id) {
+  int ticket = ems_show_async(out_fd, event_id);
+  return ticket < 0 ? 1 : ems_complete(ticket);
+}
 
-  return ret;
+int ems_list_events(int out_fd) {
+  int ticket = ems_list_events_async(out_fd);
+  return ticket < 0 ? 1 : ems_complete(ticket);
 }
@@ -3,10 +3,14 @@
 
 #include <stddef.h>
 
+#define EMS_MAX_IN_FLIGHT 64  // Requests that can be sent and not yet completed at once, a power of two.
+#define BATCH_HEADER_SIZE (1 + 5 + 1)  // Op code, session id and operation count of a batch, at most.
+
 /// Connects to an EMS server.
 /// @param req_pipe_path Path to the name pipe to be created for requests.
 /// @param resp_pipe_path Path to the name pipe to be created for responses.
-/// @param server_pipe_path Path to the name pipe where the server is listening.
+/// @param server_pipe_path Path to the name pipe where the server is listening, or to its Unix socket, in which case
+/// the request and response pipes are not used.
 /// @return 0 if the connection was established successfully, 1 otherwise.
 int ems_setup(char const* req_pipe_path, char const* resp_pipe_path, char const* server_pipe_path);
 
@@ -14,6 +18,11 @@ int ems_setup(char const* req_pipe_path, char const* resp_pipe_path, char const*
 /// @return 0 in case of success, 1 otherwise.
 int ems_quit(void);
 
+/// Moves the session to a pair of rings in memory shared with the server, for round trips without syscalls.
+/// @note Only for sessions on the server's Unix socket, which stays open so each side notices the other going away.
+/// @return 0 if the session moved, 1 if it stays where it was.
+int ems_use_shared_memory(void);
+
 /// Creates a new event with the given id and dimensions.
 /// @param event_id Id of the event to be created.
 /// @param num_rows Number of rows of the event to be created.
@@ -40,6 +49,42 @@ int ems_show(int out_fd, unsigned int event_id);
 /// @return 0 if the events were printed successfully, 1 otherwise.
 int ems_list_events(int out_fd);
 
+/// The _async versions send a request without waiting for its response and return a ticket for it, or -1 if it could
+/// not be sent. The server answers the requests of a session in order, so they pipeline: a job file runs at one round
+/// trip per EMS_MAX_IN_FLIGHT requests instead of one per request.
+/// @note A SHOW or LIST prints its response to out_fd once it comes, which is by the time its ticket completes.
+int ems_create_async(unsigned int event_id, size_t num_rows, size_t num_cols);
+int ems_reserve_async(unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys);
+int ems_show_async(int out_fd, unsigned int event_id);
+int ems_list_events_async(int out_fd);
+
+// A CREATE or RESERVE sent as part of a batch, with the arguments of ems_create or ems_reserve.
+struct EmsOperation {
+  char op_code;  // '3' for a CREATE, '4' for a RESERVE.
+  unsigned int event_id;
+  size_t num_rows, num_cols;
+  size_t num_seats;
+  size_t *xs, *ys;
+};
+
+/// Gets the number of bytes an operation takes in a batch request, which holds up to MAX_BATCH_SIZE bytes and
+/// MAX_BATCH_SEATS seats along with a header of BATCH_HEADER_SIZE.
+size_t ems_batch_operation_size(const struct EmsOperation* op);
+
+/// Sends CREATEs and RESERVEs in one request, which the server answers with the result of each. It runs them grouped
+/// by event, taking the seat locks of each event once, with the results of running them one after another.
+/// @param ops The operations, at most MAX_BATCH_OPERATIONS.
+/// @param num_ops Number of operations.
+/// @param results Where to store the result of each operation, 0 if it succeeded and 1 otherwise. ems_batch_async
+/// fills it in by the time its ticket completes.
+/// @return For ems_batch, 0 if the results were received and 1 otherwise. For ems_batch_async, a ticket.
+int ems_batch(const struct EmsOperation* ops, size_t num_ops, int* results);
+int ems_batch_async(const struct EmsOperation* ops, size_t num_ops, int* results);
 
+/// Waits for the response to a request sent with one of the _async functions, reading those to earlier requests on
+/// the way. Each ticket is completed once, which frees it for a later request.
+/// @param ticket Ticket of the request.
+/// @return What the synchronous version of the request returns.
+int ems_complete(int ticket);
 
 #endif  // CLIENT_API_H
@@ -1,5 +1,6 @@
 #include <fcntl.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
@@ -7,32 +8,151 @@
 #include "common/constants.h"
 #include "parser.h"
 
+// A request in flight: a SHOW or LIST with what to report if it fails, or a batch of CREATEs and RESERVEs.
+struct InFlight {
+  int ticket;
+  const char* failure;
+  size_t num_ops;  // Operations of a batch, 0 for any other request.
+  char op_codes[MAX_BATCH_OPERATIONS];
+  int results[MAX_BATCH_OPERATIONS];
+};
+
+static struct InFlight requests[EMS_MAX_IN_FLIGHT];  // Circular, from the oldest on.
+static size_t oldest = 0, in_flight = 0;
+static size_t max_in_flight = 1;  // 1 completes each request before sending the next.
+
+// CREATEs and RESERVEs read from the job file and not sent yet, which go to the server in one batch request.
+static struct EmsOperation batch[MAX_BATCH_OPERATIONS];
+static size_t batch_seats[2 * MAX_BATCH_SEATS];  // Rows and columns of the RESERVEs of the batch.
+static size_t batch_ops = 0, batch_size = BATCH_HEADER_SIZE, batch_seats_used = 0;
+
+/// Reports what failed of a request.
+/// @param failed Whether the whole request failed, which fails every operation of a batch.
+static void report(const struct InFlight* request, int failed) {
+  if (request->num_ops == 0) {
+    if (failed) fprintf(stderr, "%s\n", request->failure);
+    return;
+  }
+  for (size_t i = 0; i < request->num_ops; i++) {
+    if (failed || request->results[i])
+      fprintf(stderr, "%s\n", request->op_codes[i] == '3' ? "Failed to create event" : "Failed to reserve seats");
+  }
+}
+
+/// Completes the oldest request in flight, reporting what failed.
+static void complete_oldest() {
+  struct InFlight* request = &requests[oldest];
+  report(request, ems_complete(request->ticket));
+  oldest = (oldest + 1) % EMS_MAX_IN_FLIGHT;
+  in_flight--;
+}
+
+/// Gets where to keep track of the next request sent.
+static struct InFlight* next_request() { return &requests[(oldest + in_flight) % EMS_MAX_IN_FLIGHT]; }
+
+/// Keeps track of a request just sent, completing the oldest ones while as many as allowed are in flight.
+/// @param request The request, from next_request.
+/// @param ticket Ticket of the request, -1 if it was not sent.
+static void track(struct InFlight* request, int ticket) {
+  if (ticket < 0) {
+    report(request, 1);
+    return;
+  }
+  request->ticket = ticket;
+  in_flight++;
+  while (in_flight >= max_in_flight) complete_oldest();
+}
+
+/// Keeps track of a request just sent that is not a batch.
+/// @param ticket Ticket of the request, -1 if it was not sent.
+/// @param failure What to report if the request fails.
+static void track_single(int ticket, const char* failure) {
+  struct InFlight* request = next_request();
+  request->failure = failure;
+  request->num_ops = 0;
+  track(request, ticket);
+}
+
+/// Sends the CREATEs and RESERVEs read since the last request in one batch request, if there are any.
+static void send_batch() {
+  if (batch_ops == 0) return;
+
+  struct InFlight* request = next_request();
+  request->num_ops = batch_ops;
+  for (size_t i = 0; i < batch_ops; i++) request->op_codes[i] = batch[i].op_code;
+  int ticket = ems_batch_async(batch, batch_ops, request->results);
+  batch_ops = 0;
+  batch_size = BATCH_HEADER_SIZE;
+  batch_seats_used = 0;
+  track(request, ticket);
+}
+
+/// Adds a CREATE or RESERVE to the batch, sending the batch first if the operation does not fit in it.
+static void add_to_batch(struct EmsOperation op) {
+  size_t size = ems_batch_operation_size(&op);
+  if (BATCH_HEADER_SIZE + size > MAX_BATCH_SIZE) {
+    // Only RESERVEs of many seats far into huge events fit in no batch, and go on their own.
+    send_batch();
+    track_single(ems_reserve_async(op.event_id, op.num_seats, op.xs, op.ys), "Failed to reserve seats");
+    return;
+  }
+  size_t num_seats = op.op_code == '4' ? op.num_seats : 0;
+  if (batch_ops == MAX_BATCH_OPERATIONS || batch_size + size > MAX_BATCH_SIZE ||
+      batch_seats_used / 2 + num_seats > MAX_BATCH_SEATS)
+    send_batch();
+
+  if (op.op_code == '4') {
+    memcpy(batch_seats + batch_seats_used, op.xs, sizeof(size_t) * op.num_seats);
+    memcpy(batch_seats + batch_seats_used + op.num_seats, op.ys, sizeof(size_t) * op.num_seats);
+    op.xs = batch_seats + batch_seats_used;
+    op.ys = op.xs + op.num_seats;
+    batch_seats_used += 2 * op.num_seats;
+  }
+  batch[batch_ops++] = op;
+  batch_size += size;
+}
+
 int main(int argc, char* argv[]) {
-  if (argc < 5) {
-    fprintf(stderr, "Usage: %s <request pipe path> <response pipe path> <server pipe path> <.jobs file path>\n",
-            argv[0]);
+  int invalid = 0, opt;
+  while ((opt = getopt(argc, argv, "n:")) != -1) {
+    if (opt == 'n') {
+      char* end;
+      unsigned long value = strtoul(optarg, &end, 10);
+      if (*end != '\0' || value == 0 || value > EMS_MAX_IN_FLIGHT) invalid = 1;
+      max_in_flight = value;
+    } else {
+      invalid = 1;
+    }
+  }
+
+  if (argc - optind < 4 || invalid) {
+    fprintf(stderr,
+            "Usage: %s [-n <requests in flight, up to %d>] <request pipe path> <response pipe path> <server pipe path> "
+            "<.jobs file path>\n",
+            argv[0], EMS_MAX_IN_FLIGHT);
     return 1;
   }
+  char** args = argv + optind;
 
-  if (ems_setup(argv[1], argv[2], argv[3])) {
+  if (ems_setup(args[0], args[1], args[2])) {
     fprintf(stderr, "Failed to set up EMS\n");
     return 1;
   }
 
-  const char* dot = strrchr(argv[4], '.');
-  if (dot == NULL || dot == argv[4] || strlen(dot) != 5 || strcmp(dot, ".jobs") ||
-      strlen(argv[4]) > MAX_JOB_FILE_NAME_SIZE) {
-    fprintf(stderr, "The provided .jobs file path is not valid. Path: %s\n", argv[4]);
+  const char* dot = strrchr(args[3], '.');
+  if (dot == NULL || dot == args[3] || strlen(dot) != 5 || strcmp(dot, ".jobs") ||
+      strlen(args[3]) > MAX_JOB_FILE_NAME_SIZE) {
+    fprintf(stderr, "The provided .jobs file path is not valid. Path: %s\n", args[3]);
     return 1;
   }
 
   char out_path[MAX_JOB_FILE_NAME_SIZE];
-  strcpy(out_path, argv[4]);
+  strcpy(out_path, args[3]);
   strcpy(strrchr(out_path, '.'), ".out");
 
-  int in_fd = open(argv[4], O_RDONLY);
+  int in_fd = open(args[3], O_RDONLY);
   if (in_fd == -1) {
-    fprintf(stderr, "Failed to open input file. Path: %s\n", argv[4]);
+    fprintf(stderr, "Failed to open input file. Path: %s\n", args[3]);
     return 1;
   }
 
@@ -55,7 +175,8 @@ int main(int argc, char* argv[]) {
           continue;
         }
 
-        if (ems_create(event_id, num_rows, num_columns)) fprintf(stderr, "Failed to create event\n");
+        add_to_batch((struct EmsOperation){.op_code = '3', .event_id = event_id, .num_rows = num_rows,
+                                           .num_cols = num_columns});
         break;
 
       case CMD_RESERVE:
@@ -66,7 +187,8 @@ int main(int argc, char* argv[]) {
           continue;
         }
 
-        if (ems_reserve(event_id, num_coords, xs, ys)) fprintf(stderr, "Failed to reserve seats\n");
+        add_to_batch((struct EmsOperation){.op_code = '4', .event_id = event_id, .num_seats = num_coords,
+                                           .xs = xs, .ys = ys});
         break;
 
       case CMD_SHOW:
@@ -75,11 +197,13 @@ int main(int argc, char* argv[]) {
           continue;
         }
 
-        if (ems_show(out_fd, event_id)) fprintf(stderr, "Failed to show event\n");
+        send_batch();
+        track_single(ems_show_async(out_fd, event_id), "Failed to show event");
         break;
 
       case CMD_LIST_EVENTS:
-        if (ems_list_events(out_fd)) fprintf(stderr, "Failed to list events\n");
+        send_batch();
+        track_single(ems_list_events_async(out_fd), "Failed to list events");
         break;
 
       case CMD_WAIT:
@@ -88,6 +212,9 @@ int main(int argc, char* argv[]) {
             continue;
         }
 
+        // Whatever came before the wait is done by the time it starts.
+        send_batch();
+        while (in_flight > 0) complete_oldest();
         if (delay > 0) {
             printf("Waiting...\n");
             sleep(delay);
@@ -114,6 +241,8 @@ int main(int argc, char* argv[]) {
         break;
 
       case EOC:
+        send_batch();
+        while (in_flight > 0) complete_oldest();
         close(in_fd);
         close(out_fd);
         ems_quit();
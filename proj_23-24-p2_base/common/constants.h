@@ -2,4 +2,9 @@
 #define STATE_ACCESS_DELAY_US 500000  // 500ms
 #define MAX_JOB_FILE_NAME_SIZE 256
 #define MAX_SESSION_COUNT 8
-#define MAX_PIPE_NAME_SIZE 40
\ No newline at end of file
+#define SOCKET_WORKER_COUNT 4  // Threads serving every client of the socket transport
+#define MAX_SHARED_SESSION_COUNT 8  // Shared-memory sessions served at once, each by a thread of its own
+#define MAX_PIPE_NAME_SIZE 40
+#define MAX_BATCH_OPERATIONS 64  // CREATEs and RESERVEs in one batch request
+#define MAX_BATCH_SIZE 4096      // Bytes of a batch request, which the server buffers whole like any other
+#define MAX_BATCH_SEATS 256      // Seats of all the RESERVEs of a batch request
\ No newline at end of file
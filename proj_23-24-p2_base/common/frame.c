@@ -0,0 +1,54 @@
+#include "frame.h"
+
+size_t varint_size(uint64_t value) {
+  size_t size = 1;
+  while (value >= 0x80) {
+    value >>= 7;
+    size++;
+  }
+  return size;
+}
+
+size_t varint_put(char *out, uint64_t value) {
+  size_t size = 0;
+  while (value >= 0x80) {
+    out[size++] = (char)(value | 0x80);
+    value >>= 7;
+  }
+  out[size++] = (char)value;
+  return size;
+}
+
+int varint_get(const char **cursor, const char *end, uint64_t *value) {
+  uint64_t result = 0;
+  for (unsigned int shift = 0; *cursor < end && shift < 7 * VARINT_MAX_SIZE; shift += 7) {
+    unsigned char byte = (unsigned char)*(*cursor)++;
+    result |= (uint64_t)(byte & 0x7f) << shift;
+    // The last byte only has room for the top bit of a 64-bit number.
+    if (shift == 7 * (VARINT_MAX_SIZE - 1) && byte > 1) return 1;
+    if (!(byte & 0x80)) {
+      *value = result;
+      return 0;
+    }
+  }
+  return 1;
+}
+
+size_t frame_header(char *out, size_t payload_size) {
+  out[0] = (char)FRAME_VERSION;
+  return 1 + varint_put(out + 1, payload_size);
+}
+
+ssize_t frame_size(const char *data, size_t len) {
+  // Until the last byte of the payload size comes, one more byte is asked for at a time.
+  const char *cursor = data + 1;
+  uint64_t payload_size;
+  if (len < 2 || varint_get(&cursor, data + len, &payload_size) != 0) {
+    return len < FRAME_HEADER_MAX_SIZE ? (ssize_t)(len < 2 ? 2 : len + 1) : -1;
+  }
+
+  // Checked before the header is added, so a payload size near the top of the range cannot wrap around.
+  if (payload_size > MAX_FRAME_SIZE) return -1;
+  uint64_t size = (uint64_t)(cursor - data) + payload_size;
+  return size > MAX_FRAME_SIZE ? -1 : (ssize_t)size;
+}
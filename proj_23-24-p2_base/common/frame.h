@@ -0,0 +1,44 @@
+#ifndef COMMON_FRAME_H
+#define COMMON_FRAME_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// Requests of version 2 of the protocol are frames: a version byte, which no op code of version 1 is, the size of
+// the payload as a varint, and the payload. The payload holds the op code as a byte and then every number as a
+// varint, in the order of the fields of version 1, except that seats go as row and column pairs.
+#define FRAME_VERSION 0x82                        // Top bit set, then the protocol version.
+#define VARINT_MAX_SIZE 10                        // Bytes of the varint of the largest 64-bit number.
+#define FRAME_HEADER_MAX_SIZE (1 + VARINT_MAX_SIZE)  // Version byte and payload size.
+#define MAX_FRAME_SIZE 8192                       // Bytes of a whole frame, which the server buffers whole.
+
+/// Gets the number of bytes of the varint of a number.
+size_t varint_size(uint64_t value);
+
+/// Writes the varint of a number, seven bits at a time from the lowest, with the top bit set on all but the last.
+/// @param out Where to write the varint, with room for VARINT_MAX_SIZE bytes.
+/// @param value Number to write.
+/// @return Number of bytes written.
+size_t varint_put(char *out, uint64_t value);
+
+/// Reads a varint, moving the cursor past it.
+/// @param cursor Cursor into the bytes to read.
+/// @param end End of the bytes to read.
+/// @param value Pointer to the variable to store the number in.
+/// @return 0 if the varint was read, 1 if the bytes end before it does or it does not fit in 64 bits.
+int varint_get(const char **cursor, const char *end, uint64_t *value);
+
+/// Writes the header of a frame.
+/// @param out Where to write the header, with room for FRAME_HEADER_MAX_SIZE bytes.
+/// @param payload_size Number of bytes of the payload.
+/// @return Number of bytes written.
+size_t frame_header(char *out, size_t payload_size);
+
+/// Works out the size of the frame at the start of a buffer, which may only hold part of it.
+/// @param data Bytes of the frame received so far, starting with its version byte.
+/// @param len Number of bytes received so far.
+/// @return Number of bytes needed to go on, -1 if the frame is larger than MAX_FRAME_SIZE.
+ssize_t frame_size(const char *data, size_t len);
+
+#endif  // COMMON_FRAME_H
@@ -1,10 +1,47 @@
 #include "io.h"
 
+#include <errno.h>
 #include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
+// The two digits of every number below 100, so numbers are formatted two digits at a time.
+static const char digit_pairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+/// Formats an unsigned integer right-aligned at the end of a buffer.
+/// @param end Pointer one past the last byte to write, with at least 10 bytes before it.
+/// @param value The value to format.
+/// @return Pointer to the first digit written.
+static char *format_uint(char *end, unsigned int value) {
+  while (value >= 100) {
+    unsigned int pair = (value % 100) * 2;
+    value /= 100;
+    end -= 2;
+    end[0] = digit_pairs[pair];
+    end[1] = digit_pairs[pair + 1];
+  }
+
+  if (value >= 10) {
+    end -= 2;
+    end[0] = digit_pairs[value * 2];
+    end[1] = digit_pairs[value * 2 + 1];
+  } else {
+    *--end = (char)('0' + value);
+  }
+  return end;
+}
+
 int parse_uint(int fd, unsigned int *value, char *next) {
   char buf[16];
 
@@ -41,15 +78,8 @@ int parse_uint(int fd, unsigned int *value, char *next) {
 
 int print_uint(int fd, unsigned int value) {
   char buffer[16];
-  size_t i = 16;
-
-  for (; value > 0; value /= 10) {
-    buffer[--i] = '0' + (char)(value % 10);
-  }
-
-  if (i == 16) {
-    buffer[--i] = '0';
-  }
+  char *start = format_uint(buffer + 16, value);
+  size_t i = (size_t)(start - buffer);
 
   while (i < 16) {
     ssize_t written = write(fd, buffer + i, 16 - i);
@@ -77,3 +107,84 @@ int print_str(int fd, const char *str) {
 
   return 0;
 }
+
+int read_full(int fd, void *buf, size_t size) {
+  char *data = buf;
+  while (size > 0) {
+    ssize_t bytes = read(fd, data, size);
+    if (bytes == -1 && errno == EINTR) continue;
+    if (bytes <= 0) return 1;
+
+    data += (size_t)bytes;
+    size -= (size_t)bytes;
+  }
+
+  return 0;
+}
+
+void writer_init(struct Writer *writer, int fd) {
+  writer->fd = fd;
+  writer->failed = 0;
+  writer->len = 0;
+}
+
+/// Writes out the gathered output to make room for more.
+/// @param writer The writer to drain.
+static void writer_drain(struct Writer *writer) {
+  size_t written = 0;
+  while (!writer->failed && written < writer->len) {
+    ssize_t bytes = write(writer->fd, writer->data + written, writer->len - written);
+    if (bytes == -1) {
+      if (errno != EINTR) writer->failed = 1;
+      continue;
+    }
+    written += (size_t)bytes;
+  }
+  writer->len = 0;
+}
+
+void writer_uint(struct Writer *writer, unsigned int value) {
+  if (WRITER_BUFFER_SIZE - writer->len < 10) writer_drain(writer);
+
+  char digits[10];
+  char *start = format_uint(digits + 10, value);
+  size_t len = (size_t)(digits + 10 - start);
+  memcpy(writer->data + writer->len, start, len);
+  writer->len += len;
+}
+
+void writer_str(struct Writer *writer, const char *str) { writer_bytes(writer, str, strlen(str)); }
+
+void writer_bytes(struct Writer *writer, const void *data, size_t len) {
+  const char *bytes = data;
+  while (len > 0) {
+    if (writer->len == WRITER_BUFFER_SIZE) writer_drain(writer);
+
+    size_t chunk = WRITER_BUFFER_SIZE - writer->len < len ? WRITER_BUFFER_SIZE - writer->len : len;
+    memcpy(writer->data + writer->len, bytes, chunk);
+    writer->len += chunk;
+    bytes += chunk;
+    len -= chunk;
+  }
+}
+
+void writer_row(struct Writer *writer, const unsigned int *seats, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    // Up to 10 digits and a separator per seat.
+    if (WRITER_BUFFER_SIZE - writer->len < 11) writer_drain(writer);
+
+    char *end = writer->data + writer->len + 10;
+    char *start = format_uint(end, seats[i]);
+    size_t len = (size_t)(end - start);
+    memmove(writer->data + writer->len, start, len);
+    writer->len += len;
+    writer->data[writer->len++] = i + 1 < count ? ' ' : '\n';
+  }
+
+  if (count == 0) writer_str(writer, "\n");
+}
+
+int writer_flush(struct Writer *writer) {
+  writer_drain(writer);
+  return writer->failed;
+}
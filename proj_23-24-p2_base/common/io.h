@@ -1,6 +1,18 @@
 #ifndef COMMON_IO_H
 #define COMMON_IO_H
 
+#include <stddef.h>
+
+#define WRITER_BUFFER_SIZE 65536  // Bytes a writer gathers before writing them out.
+
+// Output gathered in memory and written to a file descriptor in as few writes as possible.
+struct Writer {
+  int fd;      // File descriptor to write to.
+  int failed;  // Set once a write fails, after which the output is dropped.
+  size_t len;  // Number of bytes of data not written yet.
+  char data[WRITER_BUFFER_SIZE];
+};
+
 /// Parses an unsigned integer from the given file descriptor.
 /// @param fd The file descriptor to read from.
 /// @param value Pointer to the variable to store the value in.
@@ -20,4 +32,43 @@ int print_uint(int fd, unsigned int value);
 /// @return 0 if the string was written successfully, 1 otherwise.
 int print_str(int fd, const char *str);
 
+/// Reads exactly the given number of bytes, however many reads it takes.
+/// @param fd The file descriptor to read from.
+/// @param buf Buffer to read into.
+/// @param size Number of bytes to read.
+/// @return 0 if every byte was read, 1 if the file ended or a read failed first.
+int read_full(int fd, void *buf, size_t size);
+
+/// Starts gathering output for a file descriptor.
+/// @param writer The writer to initialize.
+/// @param fd The file descriptor to write to.
+void writer_init(struct Writer *writer, int fd);
+
+/// Appends an unsigned integer to the output.
+/// @param writer The writer to append to.
+/// @param value The value to append.
+void writer_uint(struct Writer *writer, unsigned int value);
+
+/// Appends a string to the output.
+/// @param writer The writer to append to.
+/// @param str The string to append.
+void writer_str(struct Writer *writer, const char *str);
+
+/// Appends raw bytes to the output.
+/// @param writer The writer to append to.
+/// @param data The bytes to append.
+/// @param len The number of bytes to append.
+void writer_bytes(struct Writer *writer, const void *data, size_t len);
+
+/// Appends a row of seats to the output, separated by spaces and ended by a newline.
+/// @param writer The writer to append to.
+/// @param seats The seats of the row.
+/// @param count The number of seats in the row.
+void writer_row(struct Writer *writer, const unsigned int *seats, size_t count);
+
+/// Writes out the output gathered so far.
+/// @param writer The writer to flush.
+/// @return 0 if all the output since writer_init was written successfully, 1 otherwise.
+int writer_flush(struct Writer *writer);
+
 #endif  // COMMON_IO_H
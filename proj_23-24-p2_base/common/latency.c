@@ -0,0 +1,139 @@
+#include "latency.h"
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define SUB_BUCKET_BITS 4  // Each power of two is split in 16 buckets, so values are kept within 1/16.
+#define SUB_BUCKETS (1 << SUB_BUCKET_BITS)
+#define MAX_EXPONENT 40  // Latencies of 2^41 ns, over half an hour, or more land in the last bucket.
+#define NUM_BUCKETS ((MAX_EXPONENT - SUB_BUCKET_BITS + 2) * SUB_BUCKETS)
+
+// Log-linear histogram of latencies in nanoseconds, in the style of HdrHistogram.
+// Only its thread writes it, so counts are bumped with plain relaxed loads and stores.
+struct Histogram {
+  _Atomic uint64_t counts[NUM_BUCKETS];
+  _Atomic uint64_t max;
+};
+
+// Histograms of one thread. They are never freed, so samples outlive the thread that recorded them.
+struct ThreadLatencies {
+  struct Histogram histograms[LATENCY_MAX_OPS][NUM_LATENCY_PHASES];
+  struct ThreadLatencies* next;
+};
+
+static const char* phase_names[NUM_LATENCY_PHASES] = {"lock wait", "delay", "total"};
+
+static _Atomic(struct ThreadLatencies*) threads = NULL;  // Every thread that recorded a sample, newest first.
+static _Thread_local struct ThreadLatencies* local = NULL;
+static _Thread_local uint64_t op_start;
+static _Thread_local uint64_t op_phases[NUM_LATENCY_PHASES];
+
+uint64_t latency_now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+/// Returns the position of the highest bit set in a value, which must not be 0.
+static unsigned int highest_bit(uint64_t value) {
+  unsigned int bit = 0;
+  for (unsigned int shift = 32; shift > 0; shift /= 2) {
+    if (value >> shift) {
+      value >>= shift;
+      bit += shift;
+    }
+  }
+  return bit;
+}
+
+/// Returns the bucket a latency is counted in.
+static size_t bucket_index(uint64_t value) {
+  if (value < SUB_BUCKETS) return (size_t)value;
+  unsigned int exponent = highest_bit(value);
+  if (exponent > MAX_EXPONENT) return NUM_BUCKETS - 1;
+  size_t sub_bucket = (size_t)(value >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1);
+  return (exponent - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + sub_bucket;
+}
+
+/// Returns the highest latency counted in a bucket.
+static uint64_t bucket_limit(size_t index) {
+  if (index < SUB_BUCKETS) return index;
+  unsigned int exponent = (unsigned int)(index / SUB_BUCKETS) + SUB_BUCKET_BITS - 1;
+  uint64_t sub_bucket = index % SUB_BUCKETS + SUB_BUCKETS;
+  return ((sub_bucket + 1) << (exponent - SUB_BUCKET_BITS)) - 1;
+}
+
+static void record(struct Histogram* histogram, uint64_t value) {
+  _Atomic uint64_t* count = &histogram->counts[bucket_index(value)];
+  atomic_store_explicit(count, atomic_load_explicit(count, memory_order_relaxed) + 1, memory_order_relaxed);
+  if (value > atomic_load_explicit(&histogram->max, memory_order_relaxed)) {
+    atomic_store_explicit(&histogram->max, value, memory_order_relaxed);
+  }
+}
+
+void latency_begin() {
+  for (size_t i = 0; i < NUM_LATENCY_PHASES; i++) op_phases[i] = 0;
+  op_start = latency_now();
+}
+
+void latency_add(enum LatencyPhase phase, uint64_t start) { op_phases[phase] += latency_now() - start; }
+
+void latency_end(unsigned int op) {
+  op_phases[LATENCY_TOTAL] = latency_now() - op_start;
+
+  if (local == NULL) {
+    // Samples are dropped if the histograms cannot be allocated, as timing must never fail an operation.
+    struct ThreadLatencies* latencies = calloc(1, sizeof(struct ThreadLatencies));
+    if (latencies == NULL) return;
+    latencies->next = atomic_load(&threads);
+    while (!atomic_compare_exchange_weak(&threads, &latencies->next, latencies)) {
+    }
+    local = latencies;
+  }
+
+  for (size_t i = 0; i < NUM_LATENCY_PHASES; i++) record(&local->histograms[op][i], op_phases[i]);
+}
+
+/// Returns the latency below which the given fraction of the merged samples fall.
+static uint64_t percentile(const uint64_t* counts, uint64_t total, uint64_t max, double fraction) {
+  uint64_t rank = (uint64_t)(fraction * (double)total + 0.5);
+  if (rank == 0) rank = 1;
+  uint64_t seen = 0;
+  for (size_t i = 0; i < NUM_BUCKETS; i++) {
+    seen += counts[i];
+    if (seen >= rank) return bucket_limit(i) < max ? bucket_limit(i) : max;
+  }
+  return max;
+}
+
+void latency_report(FILE* out, const char* const* op_names, size_t num_ops) {
+  int header = 0;
+  for (size_t op = 0; op < num_ops && op < LATENCY_MAX_OPS; op++) {
+    for (size_t phase = 0; phase < NUM_LATENCY_PHASES; phase++) {
+      uint64_t counts[NUM_BUCKETS] = {0};
+      uint64_t total = 0, max = 0;
+      for (struct ThreadLatencies* thread = atomic_load(&threads); thread != NULL; thread = thread->next) {
+        struct Histogram* histogram = &thread->histograms[op][phase];
+        for (size_t i = 0; i < NUM_BUCKETS; i++) {
+          uint64_t count = atomic_load_explicit(&histogram->counts[i], memory_order_relaxed);
+          counts[i] += count;
+          total += count;
+        }
+        uint64_t thread_max = atomic_load_explicit(&histogram->max, memory_order_relaxed);
+        if (thread_max > max) max = thread_max;
+      }
+
+      if (total == 0) continue;
+      if (!header) {
+        fprintf(out, "%-8s %-10s %10s %10s %10s %10s %10s\n", "op", "phase", "count", "p50 us", "p90 us", "p99 us",
+                "max us");
+        header = 1;
+      }
+      fprintf(out, "%-8s %-10s %10llu %10.1f %10.1f %10.1f %10.1f\n", op_names[op], phase_names[phase],
+              (unsigned long long)total, (double)percentile(counts, total, max, 0.5) / 1e3,
+              (double)percentile(counts, total, max, 0.9) / 1e3, (double)percentile(counts, total, max, 0.99) / 1e3,
+              (double)max / 1e3);
+    }
+  }
+}
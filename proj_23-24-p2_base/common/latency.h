@@ -0,0 +1,35 @@
+#ifndef COMMON_LATENCY_H
+#define COMMON_LATENCY_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Latencies are recorded per operation, numbered from 0 by each program, which also names them for the report.
+#define LATENCY_MAX_OPS 8
+
+// Parts of an operation's latency. Lock waits and delays are summed over the whole operation.
+enum LatencyPhase { LATENCY_LOCK_WAIT, LATENCY_DELAY, LATENCY_TOTAL, NUM_LATENCY_PHASES };
+
+/// Returns the current monotonic time in nanoseconds.
+uint64_t latency_now();
+
+/// Starts timing an operation on the calling thread.
+void latency_begin();
+
+/// Adds the time since start to a phase of the calling thread's current operation.
+/// @param phase LATENCY_LOCK_WAIT or LATENCY_DELAY.
+/// @param start Time the phase started at, from latency_now.
+void latency_add(enum LatencyPhase phase, uint64_t start);
+
+/// Records the phases and total latency of the calling thread's current operation in its histograms.
+/// @param op Number of the operation that ended, below LATENCY_MAX_OPS.
+void latency_end(unsigned int op);
+
+/// Merges the histograms of every thread and prints p50/p90/p99/max per operation and phase.
+/// @note Threads keep recording while the report is made, so it may miss their latest samples.
+/// @param out File to print the report to.
+/// @param op_names Names of the operations, indexed by their numbers.
+/// @param num_ops Number of operations, at most LATENCY_MAX_OPS.
+void latency_report(FILE* out, const char* const* op_names, size_t num_ops);
+
+#endif  // COMMON_LATENCY_H
@@ -0,0 +1,129 @@
+#define _DEFAULT_SOURCE  // syscall is not part of POSIX.1-2008
+
+#include "ring.h"
+
+#include <linux/futex.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+/// Returns the current monotonic time in microseconds.
+static uint64_t now_us() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+/// Returns how long to busy-poll before sleeping. Nothing on a single CPU, where polling only keeps the other side off
+/// it.
+static uint64_t spin_us() {
+  static _Atomic long cpus = 0;
+  long online = atomic_load_explicit(&cpus, memory_order_relaxed);
+  if (online == 0) {
+    online = sysconf(_SC_NPROCESSORS_ONLN);
+    atomic_store_explicit(&cpus, online, memory_order_relaxed);
+  }
+  return online > 1 ? RING_SPIN_US : 0;
+}
+
+/// Checks whether the other side of a ring closed its socket, which it also does by exiting.
+static int peer_hung_up(int peer_fd) {
+  if (peer_fd < 0) return 0;
+  struct pollfd pfd = {.fd = peer_fd, .events = POLLIN};
+  return poll(&pfd, 1, 0) > 0 && (pfd.revents & (POLLHUP | POLLERR));
+}
+
+/// Waits until a counter moves on from the value seen, busy-polling it for a while and then sleeping on it.
+/// @param counter The counter the other side moves.
+/// @param seen Value of the counter seen last.
+/// @param waiting Flag telling the other side to wake this one when it moves the counter.
+/// @param peer_fd Socket to the other side, checked whenever a sleep times out.
+/// @return 0 once the counter moved, 1 if the other side hung up first.
+static int wait_for(_Atomic uint32_t *counter, uint32_t seen, _Atomic uint32_t *waiting, int peer_fd) {
+  uint64_t start = now_us(), spin = spin_us();
+  while (atomic_load_explicit(counter, memory_order_acquire) == seen) {
+    if (now_us() - start < spin) continue;
+
+    // The flag is set before the counter is checked again and the counter moved before the flag is read, so either
+    // this side sees the counter move or the other side sees the flag and wakes it.
+    atomic_store(waiting, 1);
+    if (atomic_load(counter) == seen) {
+      struct timespec timeout = {0, RING_CHECK_MS * 1000000};
+      syscall(SYS_futex, (uint32_t *)counter, FUTEX_WAIT, seen, &timeout, NULL, 0);
+      if (atomic_load(counter) == seen && peer_hung_up(peer_fd)) {
+        atomic_store(waiting, 0);
+        return 1;
+      }
+    }
+    atomic_store(waiting, 0);
+  }
+  return 0;
+}
+
+/// Moves a counter on and wakes the other side if it sleeps on it.
+static void advance(_Atomic uint32_t *counter, uint32_t value, _Atomic uint32_t *waiting) {
+  atomic_store(counter, value);
+  if (atomic_load(waiting)) syscall(SYS_futex, (uint32_t *)counter, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+int ring_write(struct Ring *ring, const void *data, size_t len, int peer_fd) {
+  const char *in = data;
+  while (len > 0) {
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    uint32_t room = RING_SIZE - (tail - head);
+    if (room == 0) {
+      if (wait_for(&ring->head, head, &ring->space_waiting, peer_fd)) return 1;
+      continue;
+    }
+
+    size_t offset = tail % RING_SIZE;
+    size_t chunk = len < room ? len : room;
+    if (chunk > RING_SIZE - offset) chunk = RING_SIZE - offset;
+    memcpy(ring->data + offset, in, chunk);
+    advance(&ring->tail, tail + (uint32_t)chunk, &ring->data_waiting);
+    in += chunk;
+    len -= chunk;
+  }
+  return 0;
+}
+
+char *ring_claim(struct Ring *ring, size_t len, int peer_fd) {
+  uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  size_t offset = tail % RING_SIZE;
+  if (len > RING_SIZE - offset) return NULL;
+
+  while (1) {
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    if (RING_SIZE - (tail - head) >= len) return ring->data + offset;
+    if (wait_for(&ring->head, head, &ring->space_waiting, peer_fd)) return NULL;
+  }
+}
+
+void ring_commit(struct Ring *ring, size_t len) {
+  uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  advance(&ring->tail, tail + (uint32_t)len, &ring->data_waiting);
+}
+
+int ring_read(struct Ring *ring, void *buf, size_t len, int peer_fd) {
+  char *out = buf;
+  while (len > 0) {
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (tail == head) {
+      if (wait_for(&ring->tail, tail, &ring->data_waiting, peer_fd)) return 1;
+      continue;
+    }
+
+    size_t offset = head % RING_SIZE;
+    size_t chunk = len < tail - head ? len : tail - head;
+    if (chunk > RING_SIZE - offset) chunk = RING_SIZE - offset;
+    memcpy(out, ring->data + offset, chunk);
+    advance(&ring->head, head + (uint32_t)chunk, &ring->space_waiting);
+    out += chunk;
+    len -= chunk;
+  }
+  return 0;
+}
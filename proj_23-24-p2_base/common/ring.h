@@ -0,0 +1,57 @@
+#ifndef COMMON_RING_H
+#define COMMON_RING_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define RING_SIZE ((uint32_t)1 << 20)  // Bytes of each ring, a power of two.
+#define RING_SPIN_US 50                // Time a side busy-polls a ring before sleeping on its futex.
+#define RING_CHECK_MS 100              // Time a side sleeps on a futex before checking the other side is still there.
+
+// Stream of bytes from one process to another in shared memory, with a single producer and a single consumer.
+// The counters run freely and wrap around, and are also the futex words the sides sleep on.
+struct Ring {
+  _Alignas(64) _Atomic uint32_t head;  // Bytes consumed so far. Only the consumer writes it.
+  _Atomic uint32_t space_waiting;      // Set while the producer sleeps for room.
+  _Alignas(64) _Atomic uint32_t tail;  // Bytes produced so far. Only the producer writes it.
+  _Atomic uint32_t data_waiting;       // Set while the consumer sleeps for data.
+  _Alignas(64) char data[RING_SIZE];
+};
+
+// Rings of a session moved to shared memory. The client creates it zeroed, which is two empty rings.
+struct SharedSession {
+  struct Ring requests;
+  struct Ring responses;
+};
+
+/// Writes bytes to a ring, waiting for room as needed.
+/// @param ring The ring to write to.
+/// @param data The bytes to write.
+/// @param len Number of bytes to write.
+/// @param peer_fd Socket to the consumer, whose hanging up ends the wait. -1 to wait forever.
+/// @return 0 if every byte was written, 1 if the consumer hung up first.
+int ring_write(struct Ring *ring, const void *data, size_t len, int peer_fd);
+
+/// Waits for room for bytes the caller writes in place, when they fit before the end of the ring.
+/// @param ring The ring to write to.
+/// @param len Number of bytes to write.
+/// @param peer_fd Socket to the consumer, whose hanging up ends the wait. -1 to wait forever.
+/// @return Where to write the bytes before calling ring_commit. NULL if they would wrap around or are more than the
+/// ring holds, for ring_write to take them instead, or if the consumer hung up.
+char *ring_claim(struct Ring *ring, size_t len, int peer_fd);
+
+/// Hands bytes written in place to the consumer.
+/// @param ring The ring written to.
+/// @param len Number of bytes written, at most those claimed.
+void ring_commit(struct Ring *ring, size_t len);
+
+/// Reads exactly the given number of bytes from a ring, waiting for them as needed.
+/// @param ring The ring to read from.
+/// @param buf Buffer to read into.
+/// @param len Number of bytes to read.
+/// @param peer_fd Socket to the producer, whose hanging up ends the wait. -1 to wait forever.
+/// @return 0 if every byte was read, 1 if the producer hung up first.
+int ring_read(struct Ring *ring, void *buf, size_t len, int peer_fd);
+
+#endif  // COMMON_RING_H
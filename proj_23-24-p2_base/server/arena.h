@@ -0,0 +1,58 @@
+#ifndef SERVER_ARENA_H
+#define SERVER_ARENA_H
+
+#include <stddef.h>
+
+#define ARENA_CHUNK_SIZE (1 << 20)                 // Size of the chunks small allocations are carved from.
+#define ARENA_LARGE_SIZE (ARENA_CHUNK_SIZE / 4)  // Allocations at least this big get a mapping of their own.
+
+struct ArenaBlock;
+
+// Region allocator. Memory is only given back all at once, by arena_release.
+// Blocks are anonymous mappings, so they start zeroed and pages are only touched on first write.
+// Not thread-safe: callers must serialize allocations.
+struct Arena {
+  struct ArenaBlock* blocks;  // Every chunk and large mapping, newest first.
+  char* cursor;               // Next free byte of the current chunk.
+  size_t left;                // Bytes left in the current chunk.
+  size_t mappings;            // Number of mappings made so far.
+};
+
+// Fixed-size object allocator on top of an arena, with a free list for objects given back early.
+struct Slab {
+  struct Arena* arena;  // Arena objects are carved from.
+  size_t object_size;   // Size of every object, rounded up to the arena alignment.
+  void* free_objects;   // Objects returned by slab_free, ready for reuse.
+};
+
+/// Initializes an empty arena.
+/// @param arena Arena to initialize.
+void arena_init(struct Arena* arena);
+
+/// Allocates zero-filled memory from an arena.
+/// @param arena Arena to allocate from.
+/// @param size Number of bytes to allocate.
+/// @return Pointer to the memory, aligned for any type, NULL on failure.
+void* arena_alloc(struct Arena* arena, size_t size);
+
+/// Frees every allocation of an arena at once, leaving it empty.
+/// @param arena Arena to release.
+void arena_release(struct Arena* arena);
+
+/// Initializes a slab of objects of the given size.
+/// @param slab Slab to initialize.
+/// @param arena Arena the objects are carved from.
+/// @param object_size Size of every object.
+void slab_init(struct Slab* slab, struct Arena* arena, size_t object_size);
+
+/// Allocates a zero-filled object.
+/// @param slab Slab to allocate from.
+/// @return Pointer to the object, NULL on failure.
+void* slab_alloc(struct Slab* slab);
+
+/// Gives an object back before the arena is released.
+/// @param slab Slab the object was allocated from.
+/// @param object Object to be reused by a later slab_alloc.
+void slab_free(struct Slab* slab, void* object);
+
+#endif  // SERVER_ARENA_H
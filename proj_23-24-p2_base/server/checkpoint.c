@@ -0,0 +1,387 @@
+#include "checkpoint.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define CHECKPOINT_MAGIC "EMSCKPT3"
+#define CHECKPOINT_ALIGN 64        // Alignment of the seats of small events.
+#define CHECKPOINT_PAGE_SIZE 4096  // Alignment of the seats of events spanning at least a page.
+
+// Image layout: header, then the seats of every event, then the directory of events.
+// Seats and bitmap of dense events are laid out exactly like create_event lays them out in memory, so they are
+// used in place. Sparse events only store their non-empty tiles.
+struct CheckpointHeader {
+  char magic[8];              // CHECKPOINT_MAGIC, also identifies the layout version.
+  uint64_t num_events;        // Number of directory entries.
+  uint64_t directory_offset;  // Offset of the first directory entry.
+  uint64_t log_offset;        // Log offset of the first record not covered by the image.
+};
+
+struct CheckpointEntry {
+  uint32_t id;            // Event id.
+  uint32_t reservations;  // Number of reservation ids handed out, at least the highest id in the seats.
+  uint64_t rows;          // Number of rows.
+  uint64_t cols;          // Number of columns.
+  uint64_t seats_offset;  // Offset of the seats, followed by the occupancy bitmap for dense events.
+  uint64_t num_tiles;     // Number of tiles stored at seats_offset, sparse events only.
+};
+
+// Non-empty tile of a sparse event.
+struct CheckpointTile {
+  uint64_t row;                        // Row, starting at 1.
+  uint64_t tile;                       // Tile index within the row.
+  unsigned int seats[SEAT_TILE_COLS];  // Seats of the tile, including past the last column.
+};
+
+static size_t data_size(size_t rows, size_t cols) { return (rows * cols * sizeof(unsigned int) + 7) & ~(size_t)7; }
+
+/// Checks whether create_event stores an event of the given dimensions sparsely.
+static int is_sparse(size_t rows, size_t cols) { return cols != 0 && rows > SPARSE_SEAT_THRESHOLD / cols; }
+
+static size_t seats_size(size_t rows, size_t cols) {
+  return data_size(rows, cols) + rows * ((cols + 63) / 64) * sizeof(uint64_t);
+}
+
+/// Gets the offset the seats of an event would start at, keeping big events page-aligned so they fault in alone.
+static size_t align_seats(size_t offset, size_t size) {
+  size_t align = size >= CHECKPOINT_PAGE_SIZE ? CHECKPOINT_PAGE_SIZE : CHECKPOINT_ALIGN;
+  return (offset + align - 1) & ~(align - 1);
+}
+
+/// Writes zeros until the file reaches the given offset.
+/// @return 0 if the padding was written successfully, 1 otherwise.
+static int pad_to(FILE* file, size_t* written, size_t offset) {
+  static const char zeros[CHECKPOINT_PAGE_SIZE];
+  while (*written < offset) {
+    size_t chunk = offset - *written < sizeof(zeros) ? offset - *written : sizeof(zeros);
+    if (fwrite(zeros, 1, chunk, file) != chunk) return 1;
+    *written += chunk;
+  }
+  return 0;
+}
+
+/// Writes the seats and bitmap of a dense event from its latest snapshot.
+/// @param entry Directory entry to store the number of reservation ids handed out in.
+/// @return 0 if the seats were written successfully, 1 otherwise.
+static int write_dense_seats(FILE* file, struct Event* event, struct CheckpointEntry* entry) {
+  size_t row_words = event->row_words;
+  unsigned int* seats = malloc((event->cols ? event->cols : 1) * sizeof(unsigned int));
+  uint64_t* words = calloc(row_words ? row_words : 1, sizeof(uint64_t));
+  if (!seats || !words) {
+    free(seats);
+    free(words);
+    return 1;
+  }
+
+  struct SeatSnapshot* snapshot = pin_snapshot(event);
+  // Read after pinning, so it covers every id in the snapshot.
+  entry->reservations = atomic_load(&event->reservations);
+
+  int failed = 0;
+  for (size_t row = 1; row <= event->rows && !failed; row++) {
+    copy_snapshot_row(event, snapshot, row, seats);
+    failed = fwrite(seats, sizeof(unsigned int), event->cols, file) != event->cols;
+  }
+
+  size_t padding = data_size(event->rows, event->cols) - event->rows * event->cols * sizeof(unsigned int);
+  if (!failed && padding) {
+    memset(words, 0, sizeof(uint64_t));
+    failed = fwrite(words, 1, padding, file) != padding;
+  }
+
+  // The bitmap is rebuilt from the snapshot instead of copied, as the live one may be ahead of it.
+  for (size_t row = 1; row <= event->rows && !failed; row++) {
+    copy_snapshot_row(event, snapshot, row, seats);
+    memset(words, 0, row_words * sizeof(uint64_t));
+    for (size_t col = 0; col < event->cols; col++) {
+      if (seats[col] != 0) words[col / 64] |= (uint64_t)1 << (col % 64);
+    }
+    failed = fwrite(words, sizeof(uint64_t), row_words, file) != row_words;
+  }
+
+  unpin_snapshot(event, snapshot);
+  free(seats);
+  free(words);
+  return failed;
+}
+
+/// Writes the non-empty tiles of a sparse event from its latest snapshot.
+/// @param entry Directory entry to store the number of reservation ids and tiles in.
+/// @return 0 if the tiles were written successfully, 1 otherwise.
+static int write_sparse_seats(FILE* file, struct Event* event, struct CheckpointEntry* entry) {
+  unsigned int* seats = malloc(event->row_words * SEAT_TILE_COLS * sizeof(unsigned int));
+  if (!seats) return 1;
+
+  struct SeatSnapshot* snapshot = pin_snapshot(event);
+  entry->reservations = atomic_load(&event->reservations);
+  entry->num_tiles = 0;
+
+  int failed = 0;
+  for (size_t row = 1; row <= event->rows && !failed; row++) {
+    // Columns past the last one stay 0, so every tile can be written whole.
+    memset(seats, 0, event->row_words * SEAT_TILE_COLS * sizeof(unsigned int));
+    copy_snapshot_row(event, snapshot, row, seats);
+
+    for (size_t i = 0; i < event->row_words && !failed; i++) {
+      struct CheckpointTile tile = {.row = row, .tile = i};
+      memcpy(tile.seats, &seats[i * SEAT_TILE_COLS], sizeof(tile.seats));
+
+      int empty = 1;
+      for (size_t j = 0; j < SEAT_TILE_COLS && empty; j++) {
+        empty = tile.seats[j] == 0;
+      }
+      if (empty) continue;
+
+      failed = fwrite(&tile, sizeof(tile), 1, file) != 1;
+      entry->num_tiles++;
+    }
+  }
+
+  unpin_snapshot(event, snapshot);
+  free(seats);
+  return failed;
+}
+
+/// Writes a whole checkpoint image to an open file.
+/// @return 0 if the image was written successfully, 1 otherwise.
+static int write_image(FILE* file, struct Event** events, struct CheckpointEntry* entries, size_t num_events,
+                       size_t log_offset) {
+  // The header is rewritten at the end, once the directory offset is known.
+  struct CheckpointHeader header;
+  memset(&header, 0, sizeof(header));
+  size_t written = sizeof(header);
+  if (fwrite(&header, sizeof(header), 1, file) != 1) return 1;
+
+  for (size_t i = 0; i < num_events; i++) {
+    struct Event* event = events[i];
+    entries[i].id = event->id;
+    entries[i].rows = event->rows;
+    entries[i].cols = event->cols;
+    entries[i].seats_offset = align_seats(written, event->sparse ? 0 : seats_size(event->rows, event->cols));
+    if (pad_to(file, &written, entries[i].seats_offset) != 0) return 1;
+
+    if (event->sparse) {
+      if (write_sparse_seats(file, event, &entries[i]) != 0) return 1;
+      written += entries[i].num_tiles * sizeof(struct CheckpointTile);
+    } else {
+      if (write_dense_seats(file, event, &entries[i]) != 0) return 1;
+      written += seats_size(event->rows, event->cols);
+    }
+  }
+
+  // Reservation counts are only known once the seats are written, so the directory goes last.
+  if (num_events && fwrite(entries, sizeof(struct CheckpointEntry), num_events, file) != num_events) return 1;
+
+  memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+  header.num_events = num_events;
+  header.directory_offset = written;
+  header.log_offset = log_offset;
+  if (fseek(file, 0, SEEK_SET) != 0 || fwrite(&header, sizeof(header), 1, file) != 1) return 1;
+
+  if (fflush(file) != 0 || fsync(fileno(file)) != 0) return 1;
+  return 0;
+}
+
+int checkpoint_write(struct EventList* list, const char* path, size_t log_offset) {
+  if (pthread_rwlock_rdlock(&list->rwl) != 0) {
+    fprintf(stderr, "Error locking list rwl\n");
+    return 1;
+  }
+
+  size_t num_events = 0;
+  for (struct ListNode* current = list->head; current; current = current->next) {
+    num_events++;
+  }
+
+  // Events are never freed while the state is up, so they can be written after the rwl is released.
+  struct Event** events = malloc((num_events ? num_events : 1) * sizeof(struct Event*));
+  if (!events) {
+    pthread_rwlock_unlock(&list->rwl);
+    fprintf(stderr, "Error allocating memory for checkpoint\n");
+    return 1;
+  }
+  size_t i = 0;
+  for (struct ListNode* current = list->head; current; current = current->next) {
+    events[i++] = current->event;
+  }
+  pthread_rwlock_unlock(&list->rwl);
+
+  struct CheckpointEntry* entries = calloc(num_events ? num_events : 1, sizeof(struct CheckpointEntry));
+  char* tmp_path = malloc(strlen(path) + sizeof(".tmp"));
+  if (!entries || !tmp_path) {
+    free(events);
+    free(entries);
+    free(tmp_path);
+    fprintf(stderr, "Error allocating memory for checkpoint\n");
+    return 1;
+  }
+  strcpy(tmp_path, path);
+  strcat(tmp_path, ".tmp");
+
+  // The image is written next to the old one and renamed over it, so a running server that mapped
+  // the old image keeps its pages and a crash never leaves a half-written checkpoint behind.
+  int failed = 1;
+  FILE* file = fopen(tmp_path, "wb");
+  if (file) {
+    failed = write_image(file, events, entries, num_events, log_offset);
+    failed |= fclose(file) != 0;
+    failed = failed || rename(tmp_path, path) != 0;
+    if (failed) unlink(tmp_path);
+  }
+
+  if (failed) {
+    fprintf(stderr, "Error writing checkpoint\n");
+  }
+  free(events);
+  free(entries);
+  free(tmp_path);
+  return failed;
+}
+
+/// Checks that every entry of a mapped image describes seats inside it.
+/// @return 0 if the image is valid, 1 otherwise.
+static int check_image(const char* view, size_t size) {
+  const struct CheckpointHeader* header = (const struct CheckpointHeader*)view;
+  if (size < sizeof(*header) || memcmp(header->magic, CHECKPOINT_MAGIC, sizeof(header->magic)) != 0) return 1;
+  if (header->directory_offset > size || header->directory_offset % sizeof(uint64_t) != 0 ||
+      header->num_events > (size - header->directory_offset) / sizeof(struct CheckpointEntry)) {
+    return 1;
+  }
+
+  const struct CheckpointEntry* entries = (const struct CheckpointEntry*)(view + header->directory_offset);
+  for (size_t i = 0; i < header->num_events; i++) {
+    size_t rows = entries[i].rows, cols = entries[i].cols;
+    if (cols != 0 && rows > SIZE_MAX / sizeof(uint64_t) / cols) return 1;
+    if (entries[i].seats_offset % sizeof(uint64_t) != 0 || entries[i].seats_offset > size) return 1;
+
+    size_t available = size - entries[i].seats_offset;
+    if (is_sparse(rows, cols) ? entries[i].num_tiles > available / sizeof(struct CheckpointTile)
+                              : seats_size(rows, cols) > available) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/// Rebuilds a sparse event from its tiles in the image.
+/// @note Unlike dense events, the seats are copied, which only takes time proportional to the reserved tiles.
+/// @return 0 if the event was loaded successfully, 1 otherwise.
+static int load_sparse_event(struct Event* event, const struct CheckpointEntry* entry, const char* view) {
+  size_t* rows = malloc((entry->num_tiles ? entry->num_tiles : 1) * sizeof(size_t));
+  if (!rows) return 1;
+
+  const char* cursor = view + entry->seats_offset;
+  for (size_t i = 0; i < entry->num_tiles; i++, cursor += sizeof(struct CheckpointTile)) {
+    struct CheckpointTile tile;
+    memcpy(&tile, cursor, sizeof(tile));
+    if (tile.row == 0 || tile.row > event->rows || tile.tile >= event->row_words) {
+      free(rows);
+      return 1;
+    }
+
+    rows[i] = tile.row;
+    for (size_t j = 0; j < SEAT_TILE_COLS && tile.tile * SEAT_TILE_COLS + j < event->cols; j++) {
+      if (tile.seats[j] == 0) continue;
+      size_t col = tile.tile * SEAT_TILE_COLS + j + 1;
+      if (mark_seat(event, tile.row, col, 1) != 0) {
+        free(rows);
+        return 1;
+      }
+      set_seat(event, tile.row, col, tile.seats[j]);
+    }
+  }
+
+  int failed = entry->num_tiles && publish_snapshot(event, entry->num_tiles, rows) != 0;
+  free(rows);
+  return failed;
+}
+
+int checkpoint_load(struct EventList* list, const char* path, size_t* log_offset) {
+  *log_offset = 0;
+
+  int fd = open(path, O_RDONLY);
+  if (fd == -1) {
+    if (errno == ENOENT) return 0;
+    fprintf(stderr, "Error opening checkpoint\n");
+    return 1;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) == -1 || st.st_size == 0) {
+    fprintf(stderr, "Invalid checkpoint\n");
+    close(fd);
+    return 1;
+  }
+
+  // The writable mapping backs the live seats, copying pages only when they are reserved.
+  // The read-only one keeps the seats as loaded, for snapshots to fall back to.
+  size_t size = (size_t)st.st_size;
+  char* view = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  char* image = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (view == MAP_FAILED || image == MAP_FAILED) {
+    fprintf(stderr, "Error mapping checkpoint\n");
+    if (view != MAP_FAILED) munmap(view, size);
+    if (image != MAP_FAILED) munmap(image, size);
+    return 1;
+  }
+
+  if (check_image(view, size) != 0) {
+    fprintf(stderr, "Invalid checkpoint\n");
+    munmap(view, size);
+    munmap(image, size);
+    return 1;
+  }
+
+  list->image = image;
+  list->image_view = view;
+  list->image_size = size;
+
+  const struct CheckpointHeader* header = (const struct CheckpointHeader*)view;
+  const struct CheckpointEntry* entries = (const struct CheckpointEntry*)(view + header->directory_offset);
+  for (size_t i = 0; i < header->num_events; i++) {
+    const struct CheckpointEntry* entry = &entries[i];
+    if (lookup_event(list, entry->id) != NULL) {
+      fprintf(stderr, "Invalid checkpoint\n");
+      return 1;
+    }
+
+    struct Event* event;
+    if (is_sparse(entry->rows, entry->cols)) {
+      event = create_event(list, entry->id, entry->rows, entry->cols);
+    } else {
+      char* seats = image + entry->seats_offset;
+      event = map_event(list, entry->id, entry->rows, entry->cols, (unsigned int*)seats,
+                        (uint64_t*)(seats + data_size(entry->rows, entry->cols)),
+                        (const unsigned int*)(view + entry->seats_offset));
+    }
+    if (!event) {
+      fprintf(stderr, "Error allocating memory for event\n");
+      return 1;
+    }
+    atomic_store(&event->reservations, entry->reservations);
+
+    // The event is not visible yet, so its tiles can be filled without its seat locks.
+    if (event->sparse && load_sparse_event(event, entry, view) != 0) {
+      fprintf(stderr, "Invalid checkpoint\n");
+      discard_event(list, event);
+      return 1;
+    }
+
+    if (append_to_list(list, event) != 0) {
+      fprintf(stderr, "Error appending event to list\n");
+      discard_event(list, event);
+      return 1;
+    }
+  }
+
+  *log_offset = header->log_offset;
+  return 0;
+}
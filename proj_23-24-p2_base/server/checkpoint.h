@@ -0,0 +1,25 @@
+#ifndef SERVER_CHECKPOINT_H
+#define SERVER_CHECKPOINT_H
+
+#include <stddef.h>
+
+#include "eventlist.h"
+
+/// Writes a binary image of every event of a list, replacing the previous checkpoint atomically.
+/// @note Takes the list rwl for reading while collecting the events; each event is written from its latest
+/// snapshot, so reservations keep going while the image is written.
+/// @param list Event list to write.
+/// @param path Path to the checkpoint.
+/// @param log_offset Log offset up to which every record is covered by the list, stored for the next replay.
+/// @return 0 if the checkpoint was written successfully, 1 otherwise.
+int checkpoint_write(struct EventList* list, const char* path, size_t log_offset);
+
+/// Loads a checkpoint into an empty list by mapping it, so seats are used in place and only paged in when touched.
+/// @note The caller must hold the list rwl for writing.
+/// @param list Empty event list to load into. It keeps the image mapped until it is freed.
+/// @param path Path to the checkpoint. A missing checkpoint loads nothing.
+/// @param log_offset Pointer to the variable to store the log offset to resume replaying from in.
+/// @return 0 if the checkpoint was loaded successfully, 1 otherwise.
+int checkpoint_load(struct EventList* list, const char* path, size_t* log_offset);
+
+#endif  // SERVER_CHECKPOINT_H
@@ -2,6 +2,63 @@
 
 #include <pthread.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define INDEX_INITIAL_CAPACITY 64
+
+/// Hashes an event id into a slot of an index with the given capacity.
+/// @param event_id Event id.
+/// @param capacity Number of slots of the index, a power of two.
+/// @return Slot to start probing at.
+static size_t index_slot(unsigned int event_id, size_t capacity) {
+  return (size_t)((event_id * 2654435761u) ^ (event_id >> 16)) & (capacity - 1);
+}
+
+static struct EventIndex* create_index(size_t capacity) {
+  struct EventIndex* index = malloc(sizeof(struct EventIndex) + capacity * sizeof(_Atomic(struct Event*)));
+  if (!index) return NULL;
+
+  index->capacity = capacity;
+  index->count = 0;
+  index->retired = NULL;
+  for (size_t i = 0; i < capacity; i++) {
+    atomic_init(&index->slots[i], NULL);
+  }
+  return index;
+}
+
+/// Stores an event in the first free slot of its probe sequence.
+/// @note Writers are serialized by the list rwl, readers may probe concurrently.
+static void index_insert(struct EventIndex* index, struct Event* event) {
+  size_t slot = index_slot(event->id, index->capacity);
+  while (atomic_load_explicit(&index->slots[slot], memory_order_relaxed) != NULL) {
+    slot = (slot + 1) & (index->capacity - 1);
+  }
+  atomic_store_explicit(&index->slots[slot], event, memory_order_release);
+  index->count++;
+}
+
+/// Makes room for one more event, keeping the load factor under 1/2.
+/// The replaced index is retired rather than freed, as readers may still be probing it.
+/// @return Index to insert into, NULL on failure.
+static struct EventIndex* reserve_index(struct EventList* list, size_t num_events) {
+  struct EventIndex* index = atomic_load_explicit(&list->index, memory_order_relaxed);
+  if ((index->count + num_events) * 2 <= index->capacity) return index;
+
+  size_t capacity = index->capacity * 2;
+  while ((index->count + num_events) * 2 > capacity) capacity *= 2;
+  struct EventIndex* grown = create_index(capacity);
+  if (!grown) return NULL;
+
+  for (size_t i = 0; i < index->capacity; i++) {
+    struct Event* event = atomic_load_explicit(&index->slots[i], memory_order_relaxed);
+    if (event) index_insert(grown, event);
+  }
+  grown->retired = index;
+  atomic_store_explicit(&list->index, grown, memory_order_release);
+  return grown;
+}
 
 struct EventList* create_list() {
   struct EventList* list = (struct EventList*)malloc(sizeof(struct EventList));
@@ -10,15 +67,54 @@ struct EventList* create_list() {
     free(list);
     return NULL;
   }
+  struct EventIndex* index = create_index(INDEX_INITIAL_CAPACITY);
+  if (!index) {
+    pthread_rwlock_destroy(&list->rwl);
+    free(list);
+    return NULL;
+  }
+  atomic_init(&list->index, index);
+  arena_init(&list->arena);
+  slab_init(&list->event_slab, &list->arena, sizeof(struct Event));
+  slab_init(&list->node_slab, &list->arena, sizeof(struct ListNode));
   list->head = NULL;
   list->tail = NULL;
+  list->image = NULL;
+  list->image_view = NULL;
+  list->image_size = 0;
   return list;
 }
 
+int reserve_list_room(struct EventList* list, size_t num_events) {
+  if (!list || !reserve_index(list, num_events)) return 1;
+
+  // Nodes given back to the slab are the first ones it hands out again.
+  void* nodes = NULL;
+  int failed = 0;
+  for (size_t i = 0; i < num_events && !failed; i++) {
+    void* node = slab_alloc(&list->node_slab);
+    failed = node == NULL;
+    if (node) {
+      memcpy(node, &nodes, sizeof(void*));
+      nodes = node;
+    }
+  }
+  while (nodes) {
+    void* next;
+    memcpy(&next, nodes, sizeof(void*));
+    slab_free(&list->node_slab, nodes);
+    nodes = next;
+  }
+  return failed;
+}
+
 int append_to_list(struct EventList* list, struct Event* event) {
   if (!list) return 1;
 
-  struct ListNode* new_node = (struct ListNode*)malloc(sizeof(struct ListNode));
+  struct EventIndex* index = reserve_index(list, 1);
+  if (!index) return 1;
+
+  struct ListNode* new_node = (struct ListNode*)slab_alloc(&list->node_slab);
   if (!new_node) return 1;
 
   new_node->event = event;
@@ -32,27 +128,164 @@ int append_to_list(struct EventList* list, struct Event* event) {
     list->tail = new_node;
   }
 
+  index_insert(index, event);
   return 0;
 }
 
-static void free_event(struct Event* event) {
-  if (!event) return;
-  free(event->data);
-  free(event);
+/// Creates the seat locks of an event, splitting its rows into at most SEAT_LOCK_STRIPES blocks.
+/// @return 0 if the locks were created successfully, 1 otherwise.
+static int init_seat_locks(struct EventList* list, struct Event* event) {
+  event->num_stripes = event->rows < SEAT_LOCK_STRIPES ? event->rows : SEAT_LOCK_STRIPES;
+  event->stripe_rows = event->num_stripes ? (event->rows + event->num_stripes - 1) / event->num_stripes : 0;
+  // Rounding stripe_rows up may leave trailing stripes without rows.
+  event->num_stripes = event->stripe_rows ? (event->rows + event->stripe_rows - 1) / event->stripe_rows : 0;
+  event->stripes = NULL;
+  if (event->num_stripes == 0) return 0;
+
+  event->stripes = arena_alloc(&list->arena, event->num_stripes * sizeof(pthread_mutex_t));
+  if (!event->stripes) return 1;
+
+  for (size_t i = 0; i < event->num_stripes; i++) {
+    if (pthread_mutex_init(&event->stripes[i], NULL) != 0) {
+      while (i-- > 0) {
+        pthread_mutex_destroy(&event->stripes[i]);
+      }
+      event->num_stripes = 0;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/// Allocates an event and sets up its dimensions.
+/// @return Event without seats, locks or snapshot yet, NULL on failure.
+static struct Event* alloc_event(struct EventList* list, unsigned int event_id, size_t num_rows, size_t num_cols) {
+  struct Event* event = slab_alloc(&list->event_slab);
+  if (!event) return NULL;
+
+  event->id = event_id;
+  event->rows = num_rows;
+  event->cols = num_cols;
+  atomic_init(&event->reservations, 0);
+  event->row_words = (num_cols + 63) / 64;
+  return event;
+}
+
+/// Sets up the locks and snapshot of an event whose seats are in place.
+/// @return The event, NULL on failure, in which case it is given back to the slab.
+static struct Event* init_event(struct EventList* list, struct Event* event) {
+  if (init_seat_locks(list, event) != 0) {
+    slab_free(&list->event_slab, event);
+    return NULL;
+  }
+
+  event->snapshot = NULL;
+  if (pthread_mutex_init(&event->snapshot_mutex, NULL) != 0) {
+    discard_event(list, event);
+    return NULL;
+  }
+  return event;
+}
+
+struct Event* create_event(struct EventList* list, unsigned int event_id, size_t num_rows, size_t num_cols) {
+  if (!list) return NULL;
+
+  struct Event* event = alloc_event(list, event_id, num_rows, num_cols);
+  if (!event) return NULL;
+
+  event->base = NULL;
+
+  // Huge venues only get a tile table up front, their seats are allocated a tile at a time as they are reserved.
+  if (num_cols != 0 && num_rows > SPARSE_SEAT_THRESHOLD / num_cols) {
+    event->tile_rows = arena_alloc(&list->arena, num_rows * sizeof(struct SeatTile**));
+    if (!event->tile_rows) {
+      slab_free(&list->event_slab, event);
+      return NULL;
+    }
+    event->sparse = 1;
+    event->data = NULL;
+    event->occupied = NULL;
+    atomic_init(&event->seat_bytes, num_rows * sizeof(struct SeatTile**));
+    return init_event(list, event);
+  }
+
+  // Seats and bitmap share one arena allocation. Big venues get a mapping of their own,
+  // whose pages are zero-filled by the kernel on first touch.
+  size_t data_size = (num_rows * num_cols * sizeof(unsigned int) + 7) & ~(size_t)7;
+  size_t seats_size = data_size + num_rows * event->row_words * sizeof(uint64_t);
+  char* seats = arena_alloc(&list->arena, seats_size);
+  if (!seats) {
+    slab_free(&list->event_slab, event);
+    return NULL;
+  }
+  event->sparse = 0;
+  event->tile_rows = NULL;
+  event->data = (unsigned int*)seats;
+  event->occupied = (uint64_t*)(seats + data_size);
+  atomic_init(&event->seat_bytes, seats_size);
+
+  return init_event(list, event);
+}
+
+struct Event* map_event(struct EventList* list, unsigned int event_id, size_t num_rows, size_t num_cols,
+                        unsigned int* data, uint64_t* occupied, const unsigned int* base) {
+  if (!list) return NULL;
+
+  struct Event* event = alloc_event(list, event_id, num_rows, num_cols);
+  if (!event) return NULL;
+
+  event->sparse = 0;
+  event->tile_rows = NULL;
+  event->data = data;
+  event->occupied = occupied;
+  event->base = base;
+  atomic_init(&event->seat_bytes, (size_t)((char*)(occupied + num_rows * event->row_words) - (char*)data));
+
+  return init_event(list, event);
+}
+
+/// Frees the snapshot and the tiles of an event, the only per-event memory outside the arena.
+static void free_event_memory(struct Event* event) {
+  unpin_snapshot(event, event->snapshot);
+  for (size_t row = 0; event->sparse && row < event->rows; row++) {
+    for (size_t tile = 0; event->tile_rows[row] && tile < event->row_words; tile++) {
+      free(event->tile_rows[row][tile]);
+    }
+    free(event->tile_rows[row]);
+  }
+}
+
+void discard_event(struct EventList* list, struct Event* event) {
+  if (!list || !event) return;
+  free_event_memory(event);
+  for (size_t i = 0; i < event->num_stripes; i++) {
+    pthread_mutex_destroy(&event->stripes[i]);
+  }
+  // The seats stay in the arena until the list is freed.
+  slab_free(&list->event_slab, event);
 }
 
 void free_list(struct EventList* list) {
   if (!list) return;
 
-  struct ListNode* current = list->head;
-  while (current) {
-    struct ListNode* temp = current;
-    current = current->next;
+  struct EventIndex* index = atomic_load_explicit(&list->index, memory_order_relaxed);
+  while (index) {
+    struct EventIndex* retired = index->retired;
+    free(index);
+    index = retired;
+  }
 
-    free_event(temp->event);
-    free(temp);
+  for (struct ListNode* current = list->head; current; current = current->next) {
+    free_event_memory(current->event);
   }
 
+  // Events, nodes and seats all live in the arena and go away together.
+  arena_release(&list->arena);
+  if (list->image) {
+    munmap(list->image, list->image_size);
+    munmap(list->image_view, list->image_size);
+  }
+  pthread_rwlock_destroy(&list->rwl);
   free(list);
 }
 
@@ -72,3 +305,375 @@ struct Event* get_event(struct EventList* list, unsigned int event_id, struct Li
     current = current->next;
   }
 }
+
+struct Event* lookup_event(struct EventList* list, unsigned int event_id) {
+  if (!list) return NULL;
+
+  struct EventIndex* index = atomic_load_explicit(&list->index, memory_order_acquire);
+  size_t slot = index_slot(event_id, index->capacity);
+
+  while (1) {
+    struct Event* event = atomic_load_explicit(&index->slots[slot], memory_order_acquire);
+    if (event == NULL) {
+      return NULL;
+    }
+
+    if (event->id == event_id) {
+      return event;
+    }
+
+    slot = (slot + 1) & (index->capacity - 1);
+  }
+}
+
+/// Gets the bitmap word holding a seat.
+static uint64_t* seat_word(const struct Event* event, size_t row, size_t col) {
+  return &event->occupied[(row - 1) * event->row_words + (col - 1) / 64];
+}
+
+/// Gets the tile of a sparse event holding a seat.
+/// @return The tile, NULL if no seat of it was ever reserved.
+static struct SeatTile* find_tile(const struct Event* event, size_t row, size_t col) {
+  struct SeatTile** tiles = event->tile_rows[row - 1];
+  return tiles ? tiles[(col - 1) / SEAT_TILE_COLS] : NULL;
+}
+
+/// Gets the tile of a sparse event holding a seat, allocating it and its row on first use.
+/// @note The caller must hold the seat lock of the row.
+/// @return The tile, NULL on failure.
+static struct SeatTile* get_tile(struct Event* event, size_t row, size_t col) {
+  struct SeatTile** tiles = event->tile_rows[row - 1];
+  if (!tiles) {
+    tiles = calloc(event->row_words, sizeof(struct SeatTile*));
+    if (!tiles) return NULL;
+    event->tile_rows[row - 1] = tiles;
+    atomic_fetch_add(&event->seat_bytes, event->row_words * sizeof(struct SeatTile*));
+  }
+
+  struct SeatTile** tile = &tiles[(col - 1) / SEAT_TILE_COLS];
+  if (!*tile) {
+    *tile = calloc(1, sizeof(struct SeatTile));
+    if (!*tile) return NULL;
+    atomic_fetch_add(&event->seat_bytes, sizeof(struct SeatTile));
+  }
+  return *tile;
+}
+
+/// Gets the occupancy bitmap word of a row with the given index, for dense and sparse events alike.
+static uint64_t occupied_word(const struct Event* event, size_t row, size_t word) {
+  if (!event->sparse) return event->occupied[(row - 1) * event->row_words + word];
+
+  const struct SeatTile* tile = find_tile(event, row, word * SEAT_TILE_COLS + 1);
+  return tile ? tile->occupied : 0;
+}
+
+int seat_occupied(const struct Event* event, size_t row, size_t col) {
+  return (int)((occupied_word(event, row, (col - 1) / 64) >> ((col - 1) % 64)) & 1);
+}
+
+int mark_seat(struct Event* event, size_t row, size_t col, int occupied) {
+  uint64_t* word;
+  if (event->sparse) {
+    struct SeatTile* tile = occupied ? get_tile(event, row, col) : find_tile(event, row, col);
+    if (!tile) return occupied;
+    word = &tile->occupied;
+  } else {
+    word = seat_word(event, row, col);
+  }
+
+  uint64_t bit = (uint64_t)1 << ((col - 1) % 64);
+  if (occupied) {
+    *word |= bit;
+  } else {
+    *word &= ~bit;
+  }
+  return 0;
+}
+
+unsigned int get_seat(const struct Event* event, size_t row, size_t col) {
+  if (!event->sparse) return event->data[(row - 1) * event->cols + col - 1];
+
+  const struct SeatTile* tile = find_tile(event, row, col);
+  return tile ? tile->seats[(col - 1) % SEAT_TILE_COLS] : 0;
+}
+
+void set_seat(struct Event* event, size_t row, size_t col, unsigned int reservation_id) {
+  if (!event->sparse) {
+    event->data[(row - 1) * event->cols + col - 1] = reservation_id;
+    return;
+  }
+
+  struct SeatTile* tile = find_tile(event, row, col);
+  if (tile) tile->seats[(col - 1) % SEAT_TILE_COLS] = reservation_id;
+}
+
+int any_seat_occupied(const struct Event* event, size_t row, size_t first_col, size_t last_col) {
+  if (first_col > last_col) return 0;
+
+  size_t first_word = (first_col - 1) / 64;
+  size_t last_word = (last_col - 1) / 64;
+  uint64_t first_mask = ~(uint64_t)0 << ((first_col - 1) % 64);
+  uint64_t last_mask = ~(uint64_t)0 >> (63 - (last_col - 1) % 64);
+
+  // Missing tiles read as empty words, so sparse rows are scanned a tile at a time.
+  if (event->sparse) {
+    for (size_t w = first_word; w <= last_word; w++) {
+      uint64_t word = occupied_word(event, row, w);
+      if (w == first_word) word &= first_mask;
+      if (w == last_word) word &= last_mask;
+      if (word) return 1;
+    }
+    return 0;
+  }
+
+  const uint64_t* words = &event->occupied[(row - 1) * event->row_words];
+  if (first_word == last_word) {
+    return (words[first_word] & first_mask & last_mask) != 0;
+  }
+
+  if (words[first_word] & first_mask) return 1;
+
+  // OR the inner words together without branching so the compiler can vectorize the scan.
+  uint64_t any = 0;
+  for (size_t w = first_word + 1; w < last_word; w++) {
+    any |= words[w];
+  }
+
+  return any != 0 || (words[last_word] & last_mask) != 0;
+}
+
+uint64_t row_stripe(const struct Event* event, size_t row) { return (uint64_t)1 << ((row - 1) / event->stripe_rows); }
+
+uint64_t all_stripes(const struct Event* event) {
+  return event->num_stripes == 64 ? ~(uint64_t)0 : ((uint64_t)1 << event->num_stripes) - 1;
+}
+
+void unlock_stripes(struct Event* event, uint64_t mask) {
+  for (size_t i = 0; i < event->num_stripes; i++) {
+    if (mask & ((uint64_t)1 << i)) {
+      pthread_mutex_unlock(&event->stripes[i]);
+    }
+  }
+}
+
+int lock_stripes(struct Event* event, uint64_t mask) {
+  for (size_t i = 0; i < event->num_stripes; i++) {
+    if (!(mask & ((uint64_t)1 << i))) {
+      continue;
+    }
+
+    if (pthread_mutex_lock(&event->stripes[i]) != 0) {
+      unlock_stripes(event, mask & (((uint64_t)1 << i) - 1));
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/// Gets the size of a snapshot row.
+static size_t row_bytes(const struct Event* event, const struct SeatRow* row) {
+  size_t seats = event->sparse ? row->num_tiles * (SEAT_TILE_COLS + 1) : event->cols;
+  return sizeof(struct SeatRow) + seats * sizeof(unsigned int);
+}
+
+/// Copies a row of the live seats into a new snapshot row.
+/// @note The caller must hold the seat lock of the row.
+/// @return The copy, NULL on failure.
+static struct SeatRow* copy_row(const struct Event* event, size_t row) {
+  if (!event->sparse) {
+    struct SeatRow* copy = malloc(sizeof(struct SeatRow) + event->cols * sizeof(unsigned int));
+    if (!copy) return NULL;
+    atomic_init(&copy->refs, 1);
+    copy->num_tiles = 0;
+    memcpy(copy->seats, &event->data[(row - 1) * event->cols], event->cols * sizeof(unsigned int));
+    return copy;
+  }
+
+  // Tiles that were reserved and then freed again are left out like the ones never reserved.
+  struct SeatTile* const* tiles = event->tile_rows[row - 1];
+  size_t num_tiles = 0;
+  for (size_t i = 0; tiles && i < event->row_words; i++) {
+    if (tiles[i] && tiles[i]->occupied) num_tiles++;
+  }
+
+  struct SeatRow* copy = malloc(sizeof(struct SeatRow) + num_tiles * (SEAT_TILE_COLS + 1) * sizeof(unsigned int));
+  if (!copy) return NULL;
+  atomic_init(&copy->refs, 1);
+  copy->num_tiles = num_tiles;
+
+  unsigned int* cursor = copy->seats;
+  for (size_t i = 0; tiles && i < event->row_words; i++) {
+    if (!tiles[i] || !tiles[i]->occupied) continue;
+    *cursor++ = (unsigned int)i;
+    memcpy(cursor, tiles[i]->seats, sizeof(tiles[i]->seats));
+    cursor += SEAT_TILE_COLS;
+  }
+  return copy;
+}
+
+/// Drops a reference to a snapshot row, freeing it with the last one.
+static void release_row(struct SeatRow* row) {
+  if (row && atomic_fetch_sub(&row->refs, 1) == 1) {
+    free(row);
+  }
+}
+
+/// Gets the number of rows of a stripe, the last one may be shorter.
+static size_t stripe_rows(const struct Event* event, size_t stripe) {
+  size_t first_row = stripe * event->stripe_rows;
+  return event->rows - first_row < event->stripe_rows ? event->rows - first_row : event->stripe_rows;
+}
+
+/// Drops a reference to a snapshot block, freeing it and its rows with the last one.
+static void release_block(const struct Event* event, size_t stripe, struct SeatBlock* block) {
+  if (!block || atomic_fetch_sub(&block->refs, 1) != 1) return;
+
+  for (size_t i = 0; i < stripe_rows(event, stripe); i++) {
+    release_row(block->rows[i]);
+  }
+  free(block);
+}
+
+/// Releases the blocks of a snapshot that was never published.
+static void discard_blocks(const struct Event* event, struct SeatSnapshot* snapshot) {
+  for (size_t i = 0; i < snapshot->num_blocks; i++) {
+    release_block(event, i, snapshot->blocks[i]);
+  }
+  free(snapshot);
+}
+
+/// Fills the blocks of a new snapshot for the given rows, copying each changed row once.
+/// @param current Snapshot the unchanged rows of the blocks are shared with, may be NULL.
+/// @return 0 if the blocks were built successfully, 1 otherwise.
+static int build_blocks(const struct Event* event, struct SeatSnapshot* snapshot, const struct SeatSnapshot* current,
+                        size_t num_rows, const size_t* rows) {
+  for (size_t i = 0; i < num_rows; i++) {
+    size_t stripe = (rows[i] - 1) / event->stripe_rows;
+    size_t offset = rows[i] - 1 - stripe * event->stripe_rows;
+    struct SeatBlock* block = snapshot->blocks[stripe];
+    const struct SeatBlock* previous = current ? current->blocks[stripe] : NULL;
+
+    if (!block) {
+      block = malloc(sizeof(struct SeatBlock) + stripe_rows(event, stripe) * sizeof(struct SeatRow*));
+      if (!block) return 1;
+      atomic_init(&block->refs, 1);
+      for (size_t j = 0; j < stripe_rows(event, stripe); j++) {
+        block->rows[j] = previous ? previous->rows[j] : NULL;
+        if (block->rows[j]) atomic_fetch_add(&block->rows[j]->refs, 1);
+      }
+      snapshot->blocks[stripe] = block;
+    }
+
+    // A row still shared with the previous block has not been copied for this snapshot yet.
+    if (block->rows[offset] != NULL && (!previous || block->rows[offset] != previous->rows[offset])) {
+      continue;
+    }
+
+    struct SeatRow* row = copy_row(event, rows[i]);
+    if (!row) return 1;
+    release_row(block->rows[offset]);
+    block->rows[offset] = row;
+  }
+  return 0;
+}
+
+int publish_snapshot(struct Event* event, size_t num_rows, const size_t* rows) {
+  struct SeatSnapshot* snapshot =
+      malloc(sizeof(struct SeatSnapshot) + event->num_stripes * sizeof(struct SeatBlock*));
+  if (!snapshot) return 1;
+  snapshot->num_blocks = event->num_stripes;
+  for (size_t i = 0; i < event->num_stripes; i++) {
+    snapshot->blocks[i] = NULL;
+  }
+
+  // The blocks of the changed stripes cannot be replaced by anyone else while the caller holds
+  // their seat locks, so they can be read from the current snapshot without the snapshot mutex.
+  struct SeatSnapshot* current = pin_snapshot(event);
+  int failed = build_blocks(event, snapshot, current, num_rows, rows);
+  unpin_snapshot(event, current);
+  if (failed) {
+    discard_blocks(event, snapshot);
+    return 1;
+  }
+
+  atomic_init(&snapshot->refs, 1);
+  pthread_mutex_lock(&event->snapshot_mutex);
+  struct SeatSnapshot* latest = event->snapshot;
+  snapshot->version = latest ? latest->version + 1 : 1;
+  // Blocks of other stripes are taken from the latest snapshot, which may be newer than the one read above.
+  for (size_t i = 0; latest && i < event->num_stripes; i++) {
+    if (!snapshot->blocks[i] && latest->blocks[i]) {
+      atomic_fetch_add(&latest->blocks[i]->refs, 1);
+      snapshot->blocks[i] = latest->blocks[i];
+    }
+  }
+  event->snapshot = snapshot;
+  pthread_mutex_unlock(&event->snapshot_mutex);
+
+  unpin_snapshot(event, latest);
+  return 0;
+}
+
+struct SeatSnapshot* pin_snapshot(struct Event* event) {
+  pthread_mutex_lock(&event->snapshot_mutex);
+  struct SeatSnapshot* snapshot = event->snapshot;
+  if (snapshot) {
+    atomic_fetch_add(&snapshot->refs, 1);
+  }
+  pthread_mutex_unlock(&event->snapshot_mutex);
+  return snapshot;
+}
+
+void unpin_snapshot(const struct Event* event, struct SeatSnapshot* snapshot) {
+  if (!snapshot || atomic_fetch_sub(&snapshot->refs, 1) != 1) return;
+  discard_blocks(event, snapshot);
+}
+
+void copy_snapshot_row(const struct Event* event, const struct SeatSnapshot* snapshot, size_t row,
+                       unsigned int* seats) {
+  const struct SeatRow* copy = NULL;
+  if (snapshot) {
+    size_t stripe = (row - 1) / event->stripe_rows;
+    const struct SeatBlock* block = snapshot->blocks[stripe];
+    copy = block ? block->rows[row - 1 - stripe * event->stripe_rows] : NULL;
+  }
+
+  if (!copy) {
+    // Every row changed since the event was loaded has its own copy, so the others still match the base.
+    if (event->base) {
+      memcpy(seats, &event->base[(row - 1) * event->cols], event->cols * sizeof(unsigned int));
+    } else {
+      memset(seats, 0, event->cols * sizeof(unsigned int));
+    }
+    return;
+  }
+
+  if (!event->sparse) {
+    memcpy(seats, copy->seats, event->cols * sizeof(unsigned int));
+    return;
+  }
+
+  memset(seats, 0, event->cols * sizeof(unsigned int));
+  for (size_t i = 0; i < copy->num_tiles; i++) {
+    const unsigned int* tile = &copy->seats[i * (SEAT_TILE_COLS + 1)];
+    size_t first_col = tile[0] * SEAT_TILE_COLS;
+    size_t count = event->cols - first_col < SEAT_TILE_COLS ? event->cols - first_col : SEAT_TILE_COLS;
+    memcpy(&seats[first_col], &tile[1], count * sizeof(unsigned int));
+  }
+}
+
+size_t snapshot_bytes(const struct Event* event, const struct SeatSnapshot* snapshot) {
+  if (!snapshot) return 0;
+
+  size_t bytes = sizeof(struct SeatSnapshot) + snapshot->num_blocks * sizeof(struct SeatBlock*);
+  for (size_t i = 0; i < snapshot->num_blocks; i++) {
+    const struct SeatBlock* block = snapshot->blocks[i];
+    if (!block) continue;
+
+    bytes += sizeof(struct SeatBlock) + stripe_rows(event, i) * sizeof(struct SeatRow*);
+    for (size_t j = 0; j < stripe_rows(event, i); j++) {
+      if (block->rows[j]) bytes += row_bytes(event, block->rows[j]);
+    }
+  }
+  return bytes;
+}
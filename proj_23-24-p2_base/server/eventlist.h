@@ -2,17 +2,66 @@
 #define SERVER_EVENT_LIST_H
 
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stddef.h>
+#include <stdint.h>
+
+#include "arena.h"
+
+#define SEAT_LOCK_STRIPES 64  // Maximum number of seat locks per event, one bit each in a stripe mask.
+#define SEAT_TILE_COLS 64     // Seats per tile of a sparse event, one bitmap word.
+#define SPARSE_SEAT_THRESHOLD ((size_t)1 << 20)  // Events with more seats than this are stored sparsely.
+
+// Seats of SEAT_TILE_COLS consecutive columns of one row of a sparse event.
+struct SeatTile {
+  uint64_t occupied;                   // Occupancy bitmap of the tile.
+  unsigned int seats[SEAT_TILE_COLS];  // Reservation of each seat, 0 if free.
+};
+
+// Immutable copy of the seats of one row, shared by every snapshot that did not touch it.
+// Rows of sparse events only hold their non-empty tiles, each as its tile index followed by its seats.
+struct SeatRow {
+  atomic_uint refs;      // Blocks holding the row.
+  size_t num_tiles;      // Number of tiles held, sparse events only.
+  unsigned int seats[];  // Seats of the row.
+};
+
+// Immutable view of the rows of one seat lock stripe, shared like its rows.
+struct SeatBlock {
+  atomic_uint refs;         // Snapshots holding the block.
+  struct SeatRow* rows[];  // NULL for rows that never had a reservation.
+};
+
+// Immutable, versioned view of every seat of an event.
+struct SeatSnapshot {
+  atomic_uint refs;            // Pinned readers, plus one while the event publishes the snapshot.
+  unsigned long version;       // Number of snapshots published before this one.
+  size_t num_blocks;           // One block per seat lock stripe.
+  struct SeatBlock* blocks[];  // NULL for blocks that never had a reservation.
+};
 
 struct Event {
-  unsigned int id;            /// Event id
-  unsigned int reservations;  /// Number of reservations for the event.
+  unsigned int id;           /// Event id
+  atomic_uint reservations;  /// Number of reservations for the event.
 
   size_t cols;  /// Number of columns.
   size_t rows;  /// Number of rows.
 
-  unsigned int* data;     /// Array of size rows * cols with the reservations for each seat.
-  pthread_mutex_t mutex;  // Mutex to protect the event
+  unsigned int* data;        /// Array of size rows * cols with the reservations for each seat, NULL if sparse.
+  uint64_t* occupied;        /// Occupancy bitmap, one bit per seat. Every row starts on a new word. NULL if sparse.
+  size_t row_words;          /// Number of bitmap words per row, which is also the number of tiles per row.
+  const unsigned int* base;  /// Seats as loaded from a checkpoint, NULL for events created since.
+
+  int sparse;                    /// Whether seats live in tiles allocated on first reservation instead of data.
+  struct SeatTile*** tile_rows;  /// Tiles of each row of a sparse event, NULL until the row gets a reservation.
+  atomic_size_t seat_bytes;      /// Bytes of seat storage, growing as a sparse event fills.
+
+  size_t stripe_rows;        /// Number of consecutive rows protected by each seat lock.
+  size_t num_stripes;        /// Number of seat locks.
+  pthread_mutex_t* stripes;  // Seat locks, always taken in ascending order.
+
+  struct SeatSnapshot* snapshot;   /// Latest published snapshot, NULL before the first reservation.
+  pthread_mutex_t snapshot_mutex;  // Only guards swapping and pinning the snapshot pointer.
 };
 
 struct ListNode {
@@ -20,26 +69,76 @@ struct ListNode {
   struct ListNode* next;
 };
 
+// Open-addressing hash index over the events of a list, keyed by event id.
+struct EventIndex {
+  size_t capacity;             // Number of slots, always a power of two.
+  size_t count;                // Number of occupied slots.
+  struct EventIndex* retired;  // Older, smaller index kept alive for concurrent readers.
+  _Atomic(struct Event*) slots[];
+};
+
 // Linked list structure
 struct EventList {
-  struct ListNode* head;  // Head of the list
-  struct ListNode* tail;  // Tail of the list
-  pthread_rwlock_t rwl;   // Mutex to protect the list
+  struct ListNode* head;              // Head of the list
+  struct ListNode* tail;              // Tail of the list
+  pthread_rwlock_t rwl;               // Mutex to protect the list
+  _Atomic(struct EventIndex*) index;  // Hash index used by lookup_event
+  struct Arena arena;                 // Backs the events, nodes and seats of the list
+  struct Slab event_slab;             // Events of the list
+  struct Slab node_slab;              // Nodes of the list
+  void* image;                        // Writable mapping of the checkpoint backing loaded seats, NULL if none
+  void* image_view;                   // Read-only mapping of the same checkpoint, backing the base seats
+  size_t image_size;                  // Size of both checkpoint mappings
 };
 
 /// Creates a new event list.
 /// @return Newly created event list, NULL on failure
 struct EventList* create_list();
 
+/// Makes room for more events, so that appending up to that many cannot fail.
+/// @note The caller must hold the list rwl for writing.
+/// @param list Event list to be modified.
+/// @param num_events Number of events to make room for.
+/// @return 0 if there is room, 1 otherwise.
+int reserve_list_room(struct EventList* list, size_t num_events);
+
 /// Appends a new node to the list.
+/// @note The caller must hold the list rwl for writing.
 /// @param list Event list to be modified.
 /// @param data Event to be stored in the new node.
 /// @return 0 if the node was appended successfully, 1 otherwise.
 int append_to_list(struct EventList* list, struct Event* data);
 
-/// Removes a node from the list.
-/// @param list Event list to be modified.
-/// @return 0 if the node was removed successfully, 1 otherwise.
+/// Allocates a new event with every seat free, ready to be appended to the list.
+/// @note The caller must hold the list rwl for writing.
+/// @param list Event list whose arena backs the event.
+/// @param event_id Event id.
+/// @param num_rows Number of rows.
+/// @param num_cols Number of columns.
+/// @return Newly created event, NULL on failure.
+struct Event* create_event(struct EventList* list, unsigned int event_id, size_t num_rows, size_t num_cols);
+
+/// Allocates a new event whose seats and bitmap live in memory owned by the caller, e.g. a checkpoint image.
+/// @note The caller must hold the list rwl for writing.
+/// @param list Event list whose arena backs the event.
+/// @param event_id Event id.
+/// @param num_rows Number of rows.
+/// @param num_cols Number of columns.
+/// @param data Seats of the event, laid out like the data of create_event.
+/// @param occupied Occupancy bitmap matching data, laid out like the bitmap of create_event.
+/// @param base Immutable copy of data that snapshots fall back to for rows they do not hold.
+/// @return Newly created event, NULL on failure.
+struct Event* map_event(struct EventList* list, unsigned int event_id, size_t num_rows, size_t num_cols,
+                        unsigned int* data, uint64_t* occupied, const unsigned int* base);
+
+/// Gives back an event that was never appended to the list.
+/// @note The caller must hold the list rwl for writing.
+/// @param list Event list the event was created from.
+/// @param event Event to be discarded.
+void discard_event(struct EventList* list, struct Event* event);
+
+/// Frees the list with all its events at once.
+/// @param list Event list to be freed.
 void free_list(struct EventList* list);
 
 /// Retrieves an event in the list.
@@ -50,4 +149,108 @@ void free_list(struct EventList* list);
 /// @return Pointer to the event if found, NULL otherwise.
 struct Event* get_event(struct EventList* list, unsigned int event_id, struct ListNode* from, struct ListNode* to);
 
+/// Retrieves an event through the hash index.
+/// @note Does not require the list rwl: events are only removed by free_list.
+/// @param list Event list to be searched
+/// @param event_id Event id.
+/// @return Pointer to the event if found, NULL otherwise.
+struct Event* lookup_event(struct EventList* list, unsigned int event_id);
+
+/// Checks whether a seat is occupied.
+/// @note This function assumes that the seat exists.
+/// @param event Event to check.
+/// @param row Row of the seat, starting at 1.
+/// @param col Column of the seat, starting at 1.
+/// @return 1 if the seat is occupied, 0 otherwise.
+int seat_occupied(const struct Event* event, size_t row, size_t col);
+
+/// Marks a seat as occupied or free.
+/// @note This function assumes that the seat exists.
+/// @param event Event to modify.
+/// @param row Row of the seat, starting at 1.
+/// @param col Column of the seat, starting at 1.
+/// @param occupied 1 to mark the seat as occupied, 0 to free it.
+/// @return 0 if the seat was marked, 1 if storage for it could not be allocated.
+int mark_seat(struct Event* event, size_t row, size_t col, int occupied);
+
+/// Gets the reservation of a seat from the live seats.
+/// @note The caller must hold the seat lock of the row.
+/// @param event Event to read.
+/// @param row Row of the seat, starting at 1.
+/// @param col Column of the seat, starting at 1.
+/// @return Reservation id of the seat, 0 if it is free.
+unsigned int get_seat(const struct Event* event, size_t row, size_t col);
+
+/// Sets the reservation of a seat in the live seats.
+/// @note The seat must be marked occupied, which allocates its storage.
+/// @param event Event to modify.
+/// @param row Row of the seat, starting at 1.
+/// @param col Column of the seat, starting at 1.
+/// @param reservation_id Reservation id, 0 to free the seat.
+void set_seat(struct Event* event, size_t row, size_t col, unsigned int reservation_id);
+
+/// Checks whether any seat of a row range is occupied, a whole bitmap word at a time.
+/// @param event Event to check.
+/// @param row Row to check, starting at 1.
+/// @param first_col First column of the range, starting at 1.
+/// @param last_col Last column of the range, inclusive.
+/// @return 1 if at least one seat in the range is occupied, 0 otherwise.
+int any_seat_occupied(const struct Event* event, size_t row, size_t first_col, size_t last_col);
+
+/// Gets the stripe mask bit of the seat lock protecting a row.
+/// @note This function assumes that the row exists.
+/// @param event Event the row belongs to.
+/// @param row Row, starting at 1.
+/// @return Mask with only the bit of the row's seat lock set.
+uint64_t row_stripe(const struct Event* event, size_t row);
+
+/// Gets the stripe mask covering every seat lock of an event.
+/// @param event Event to get the mask of.
+/// @return Mask with the bits of all the event's seat locks set.
+uint64_t all_stripes(const struct Event* event);
+
+/// Locks the seat locks in a stripe mask, in ascending order so concurrent callers cannot deadlock.
+/// @param event Event to lock.
+/// @param mask Stripe mask of the locks to take.
+/// @return 0 if the locks were taken, 1 otherwise. On failure no lock is held.
+int lock_stripes(struct Event* event, uint64_t mask);
+
+/// Unlocks the seat locks in a stripe mask.
+/// @param event Event to unlock.
+/// @param mask Stripe mask of the locks to release.
+void unlock_stripes(struct Event* event, uint64_t mask);
+
+/// Publishes a new snapshot of an event, copying only the rows that changed.
+/// @note The caller must hold the seat locks of every changed row.
+/// @param event Event whose seats changed.
+/// @param num_rows Number of entries in rows.
+/// @param rows Rows that changed, starting at 1. Repeated rows are copied once.
+/// @return 0 if the snapshot was published successfully, 1 otherwise.
+int publish_snapshot(struct Event* event, size_t num_rows, const size_t* rows);
+
+/// Pins the latest snapshot of an event, without taking any seat lock.
+/// @param event Event to get the snapshot of.
+/// @return Pinned snapshot, NULL if the event has no reservations yet.
+struct SeatSnapshot* pin_snapshot(struct Event* event);
+
+/// Releases a snapshot returned by pin_snapshot.
+/// @param event Event the snapshot belongs to.
+/// @param snapshot Snapshot to release, may be NULL.
+void unpin_snapshot(const struct Event* event, struct SeatSnapshot* snapshot);
+
+/// Copies the seats of a row in a snapshot.
+/// @note Rows of loaded events that were not reserved since come from the event base.
+/// @param event Event the snapshot belongs to.
+/// @param snapshot Snapshot to read, may be NULL.
+/// @param row Row, starting at 1.
+/// @param seats Array of cols seats to copy the row to. Free seats are copied as 0.
+void copy_snapshot_row(const struct Event* event, const struct SeatSnapshot* snapshot, size_t row,
+                       unsigned int* seats);
+
+/// Gets the memory held by a snapshot, counting its shared blocks and rows as its own.
+/// @param event Event the snapshot belongs to.
+/// @param snapshot Snapshot to measure, may be NULL.
+/// @return Size of the snapshot in bytes.
+size_t snapshot_bytes(const struct Event* event, const struct SeatSnapshot* snapshot);
+
 #endif  // SERVER_EVENT_LIST_H
@@ -13,6 +13,8 @@
 #include "common/constants.h"
 #include "common/io.h"
 #include "operations.h"
+#include "requests.h"
+#include "sockets.h"
 
 typedef struct {
     char request_pipe[MAX_PIPE_NAME_SIZE], response_pipe[MAX_PIPE_NAME_SIZE];
@@ -24,18 +26,24 @@ pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
 pthread_mutex_t stdout_mutex = PTHREAD_MUTEX_INITIALIZER; 
 pthread_cond_t canCons, canProd;
 
-int sigint_flag = 0;
+volatile sig_atomic_t sigint_flag = 0;
+volatile sig_atomic_t checkpoint_flag = 0;
 
 void SIGUSR1_handler() {
   sigint_flag = 1;
 }
 
+void SIGUSR2_handler() {
+  checkpoint_flag = 1;
+}
+
 void *process_client(void *arg){ 
   int thread_id = *((int*) arg);
 
   sigset_t mask;
   sigemptyset(&mask);
   sigaddset(&mask, SIGUSR1);
+  sigaddset(&mask, SIGUSR2);
 
   pthread_mutex_lock(&stdout_mutex);
   if (pthread_sigmask(SIG_BLOCK, &mask, NULL) != 0) {
@@ -69,71 +77,71 @@ void *process_client(void *arg){
       
     write(fd_resp, &thread_id, sizeof(int));
 
-    int client_active = 1;
-    while (client_active){
-      char OP_CODE;
-      int ret, client_id;
-      unsigned int event_id;
-      size_t num_rows, num_cols, num_seats;
-      size_t xs[MAX_RESERVATION_SIZE], ys[MAX_RESERVATION_SIZE];
-
-      // client terminates during process
-      if(read(fd_req, &OP_CODE, sizeof(char)) == 0){
-        client_active = 0;
+    // Requests are read in bulk and run in the order they came, so a client keeping several in flight gets them all
+    // answered for one read, and the start of the next one is kept for the read after.
+    char requests[MAX_REQUEST_SIZE];
+    size_t len = 0;
+    int done = 0;
+    while (!done) {
+      ssize_t bytes = read(fd_req, requests + len, MAX_REQUEST_SIZE - len);
+      if (bytes == -1 && errno == EINTR)
+        continue;
+      if (bytes <= 0)
         break;
-      }
-      read(fd_req, &client_id, sizeof(int));
-      if (client_id == thread_id){
-        switch(OP_CODE){
-          case '2':
-            close(fd_req);
-            close(fd_resp);
-            client_active = 0;
-            break;
-
-          case '3':
-            read(fd_req, &event_id, sizeof(unsigned int));
-            read(fd_req, &num_rows, sizeof(size_t));
-            read(fd_req, &num_cols, sizeof(size_t));
-            ret = ems_create(event_id, num_rows, num_cols);
-            if(write(fd_resp, &ret, sizeof(int)) == -1 && errno == EPIPE)
-              client_active = 0;
-            break;
-
-          case '4':
-            read(fd_req, &event_id, sizeof(unsigned int));
-            read(fd_req, &num_seats, sizeof(size_t));
-            read(fd_req, xs, sizeof(size_t)*num_seats);
-            read(fd_req, ys, sizeof(size_t)*num_seats);
-            ret = ems_reserve(event_id, num_seats, xs, ys);
-            if(write(fd_resp, &ret, sizeof(int)) == -1 && errno == EPIPE)
-              client_active = 0;
-            break;
-
-          case '5':
-            read(fd_req, &event_id, sizeof(unsigned int));
-            ems_show(fd_resp, event_id);
-            break;
-
-          case '6':
-            ems_list_events(fd_resp);
-            break;
+      len += (size_t)bytes;
+
+      size_t start = 0;
+      ssize_t size;
+      while ((size = request_size(requests + start, len - start)) > 0 && (size_t)size <= len - start) {
+        if (handle_request(requests + start, thread_id, fd_resp, NULL) != 0) {
+          done = 1;
+          break;
         }
+        start += (size_t)size;
       }
+      if (size < 0)
+        break;
+
+      memmove(requests, requests + start, len - start);
+      len -= start;
     }
+    close(fd_req);
+    close(fd_resp);
   }
 }
 
 int main(int argc, char* argv[]) {
-  if (argc < 2 || argc > 3) {
-    fprintf(stderr, "Usage: %s\n <pipe_path> [delay]\n", argv[0]);
+  const char *log_path = NULL, *checkpoint_path = NULL, *socket_path = NULL;
+  int async_log = 0, opt;
+  while ((opt = getopt(argc, argv, "l:ac:s:")) != -1) {
+    switch (opt) {
+      case 'l':
+        log_path = optarg;
+        break;
+      case 'c':
+        checkpoint_path = optarg;
+        break;
+      case 'a':
+        async_log = 1;
+        break;
+      case 's':
+        socket_path = optarg;
+        break;
+      default:
+        fprintf(stderr, "Usage: %s [-c <checkpoint_path>] [-l <log_path> [-a]] [-s <socket_path>] <pipe_path> [delay]\n", argv[0]);
+        return 1;
+    }
+  }
+
+  if (argc - optind < 1 || argc - optind > 2) {
+    fprintf(stderr, "Usage: %s [-c <checkpoint_path>] [-l <log_path> [-a]] [-s <socket_path>] <pipe_path> [delay]\n", argv[0]);
     return 1;
   }
 
   char* endptr;
   unsigned int state_access_delay_us = STATE_ACCESS_DELAY_US;
-  if (argc == 3) {
-    unsigned long int delay = strtoul(argv[2], &endptr, 10);
+  if (argc - optind == 2) {
+    unsigned long int delay = strtoul(argv[optind + 1], &endptr, 10);
 
     if (*endptr != '\0' || delay > UINT_MAX) {
       fprintf(stderr, "Invalid delay value or value too large\n");
@@ -148,6 +156,16 @@ int main(int argc, char* argv[]) {
     return 1;
   }
 
+  if (checkpoint_path != NULL && ems_load_checkpoint(checkpoint_path)) {
+    fprintf(stderr, "Failed to load checkpoint\n");
+    return 1;
+  }
+
+  if (log_path != NULL && ems_open_log(log_path, async_log)) {
+    fprintf(stderr, "Failed to open log\n");
+    return 1;
+  }
+
   pthread_t thread_array[MAX_SESSION_COUNT];
   for (int i = 0; i < MAX_SESSION_COUNT; i++){
     int *arg = malloc(sizeof(int));
@@ -158,14 +176,26 @@ int main(int argc, char* argv[]) {
     }
   }
 
-  const char* pipe_path = argv[1];
+  if (socket_path != NULL && sockets_start(socket_path, SOCKET_WORKER_COUNT)) {
+    fprintf(stderr, "Failed to serve socket\n");
+    return 1;
+  }
+
+  const char* pipe_path = argv[optind];
   unlink(pipe_path);
   if (mkfifo(pipe_path, 0666) == -1){
     fprintf(stderr, "Error creating pipe.\n");
     return 1;
   }
 
-  signal(SIGUSR1, SIGUSR1_handler);
+  // Without SA_RESTART, so a signal interrupts the wait for the next client and is handled right away.
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  sigemptyset(&action.sa_mask);
+  action.sa_handler = SIGUSR1_handler;
+  sigaction(SIGUSR1, &action, NULL);
+  action.sa_handler = SIGUSR2_handler;
+  sigaction(SIGUSR2, &action, NULL);
   signal(SIGPIPE, SIG_IGN);
   
   while (1) {
@@ -183,35 +213,59 @@ int main(int argc, char* argv[]) {
       pthread_mutex_lock(&stdout_mutex);
       if (ems_show_all_events()) 
         fprintf(stderr, "Failed to show all events\n");
+      fflush(stdout);
+      // Diagnostics go to stderr, so stdout holds only the events.
+      size_t hits, misses;
+      ems_cache_stats(&hits, &misses);
+      fprintf(stderr, "Event cache: %zu hits, %zu misses\n", hits, misses);
+      if (ems_memory_report(stderr))
+        fprintf(stderr, "Failed to report memory usage\n");
+      ems_latency_report(stderr);
       pthread_mutex_unlock(&stdout_mutex);
-      close(fd_serv);
-      continue;
     }
 
-    if(read(fd_serv, &OP_CODE, sizeof(char)) < 1)
-      fprintf(stderr, "Error reading from server pipe.\n");
+    if (checkpoint_flag){
+      checkpoint_flag = 0;
+      if (checkpoint_path == NULL)
+        fprintf(stderr, "No checkpoint path given, ignoring SIGUSR2.\n");
+      else if (ems_checkpoint(checkpoint_path))
+        fprintf(stderr, "Failed to write checkpoint\n");
+    }
 
-    if(read(fd_serv, request_pipe, sizeof(char) * MAX_PIPE_NAME_SIZE) < MAX_PIPE_NAME_SIZE)
-      fprintf(stderr, "Error reading from server pipe.\n");
+    // A signal may also arrive after a client connected, whose registration must then still be read.
+    if (fd_serv < 0)
+      continue;
 
-    if(read(fd_serv, response_pipe, sizeof(char) * MAX_PIPE_NAME_SIZE) < MAX_PIPE_NAME_SIZE)
-      fprintf(stderr, "Error reading from server pipe.\n");
+    // Clients connecting together leave their registrations in the pipe one after the other, and those still there
+    // when it is closed are lost, so all of them are read first. After an interrupted open, Linux may also let a later
+    // open return before any client opened the pipe, and then nothing is read at all.
+    ssize_t op_bytes;
+    while ((op_bytes = read(fd_serv, &OP_CODE, sizeof(char))) == 1 || (op_bytes == -1 && errno == EINTR)) {
+      if (op_bytes != 1)
+        continue;
 
-    Session client_session;
-    memcpy(client_session.request_pipe, request_pipe, sizeof(char)*MAX_PIPE_NAME_SIZE);
-    memcpy(client_session.response_pipe, response_pipe, sizeof(char)*MAX_PIPE_NAME_SIZE);
+      if(read(fd_serv, request_pipe, sizeof(char) * MAX_PIPE_NAME_SIZE) < MAX_PIPE_NAME_SIZE)
+        fprintf(stderr, "Error reading from server pipe.\n");
 
-    pthread_mutex_lock(&mutex);
+      if(read(fd_serv, response_pipe, sizeof(char) * MAX_PIPE_NAME_SIZE) < MAX_PIPE_NAME_SIZE)
+        fprintf(stderr, "Error reading from server pipe.\n");
 
-    while (sessions == MAX_SESSION_COUNT) 
-      pthread_cond_wait(&canProd,&mutex);
+      Session client_session;
+      memcpy(client_session.request_pipe, request_pipe, sizeof(char)*MAX_PIPE_NAME_SIZE);
+      memcpy(client_session.response_pipe, response_pipe, sizeof(char)*MAX_PIPE_NAME_SIZE);
 
-    buffer[prod_ptr++] = client_session; 
-    if(prod_ptr == MAX_SESSION_COUNT) 
-      prod_ptr = 0;
-    sessions++;
-    pthread_cond_signal(&canCons);
-    pthread_mutex_unlock(&mutex);
+      pthread_mutex_lock(&mutex);
+
+      while (sessions == MAX_SESSION_COUNT) 
+        pthread_cond_wait(&canProd,&mutex);
+
+      buffer[prod_ptr++] = client_session; 
+      if(prod_ptr == MAX_SESSION_COUNT) 
+        prod_ptr = 0;
+      sessions++;
+      pthread_cond_signal(&canCons);
+      pthread_mutex_unlock(&mutex);
+    }
 
     close(fd_serv);
   }
@@ -1,3 +1,5 @@
+#include <limits.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -5,32 +7,145 @@
 #include <unistd.h>
 
 #include "common/io.h"
+#include "common/latency.h"
+#include "common/ring.h"
 #include "common/constants.h"
+#include "checkpoint.h"
 #include "eventlist.h"
+#include "operations.h"
+#include "wal.h"
+
+// Operations whose latency is recorded, named in latency_names.
+enum LatencyOp { LATENCY_CREATE, LATENCY_RESERVE, LATENCY_SHOW, LATENCY_LIST, LATENCY_BATCH, NUM_LATENCY_OPS };
+_Static_assert(NUM_LATENCY_OPS <= LATENCY_MAX_OPS, "every operation gets its own histograms");
+static const char* const latency_names[NUM_LATENCY_OPS] = {"create", "reserve", "show", "list", "batch"};
+
+#define EVENT_CACHE_SIZE 8  // Event handles cached by each worker thread, direct-mapped by id.
+
+// Events resolved by a worker thread. Events are only freed when the whole state is, so handles
+// stay valid until the state generation changes.
+struct EventCache {
+  unsigned long generation;
+  unsigned int ids[EVENT_CACHE_SIZE];
+  struct Event* events[EVENT_CACHE_SIZE];
+};
 
 static struct EventList* event_list = NULL;
 static unsigned int state_access_delay_us = 0;
+static size_t log_replay_start = 0;  // Log offset the loaded checkpoint is up to date with.
+static atomic_ulong state_generation = 1;  // Bumped whenever the state is torn down.
+static atomic_size_t cache_hits = 0, cache_misses = 0;
+static _Thread_local struct EventCache event_cache;
+
+// Operation whose records are logged but not yet in the state, while it waits for them to be durable.
+struct PendingOp {
+  size_t log_offset;     // Log offset at or before its first record.
+  struct Event* created;  // Event being created by a CREATE, NULL otherwise.
+  struct PendingOp *prev, *next;
+};
+
+// Pending operations, oldest first, so the first one bounds the log offset checkpoints are up to date with.
+static pthread_mutex_t pending_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct PendingOp *pending_head = NULL, *pending_tail = NULL;
+static size_t num_pending_creates = 0;  // Protected by the list rwl rather than pending_mutex.
 
 /// Gets the event with the given ID from the state.
 /// @note Will wait to simulate a real system accessing a costly memory resource.
+/// @note Goes through the hash index, so the list rwl does not have to be held.
 /// @param event_id The ID of the event to get.
-/// @param from First node to be searched.
-/// @param to Last node to be searched.
 /// @return Pointer to the event if found, NULL otherwise.
-static struct Event* get_event_with_delay(unsigned int event_id, struct ListNode* from, struct ListNode* to) {
+static struct Event* get_event_with_delay(unsigned int event_id) {
   struct timespec delay = {0, state_access_delay_us * 1000};
+  uint64_t start = latency_now();
   nanosleep(&delay, NULL);  // Should not be removed
+  latency_add(LATENCY_DELAY, start);
 
-  return get_event(event_list, event_id, from, to);
+  return lookup_event(event_list, event_id);
 }
 
-/// Gets the index of a seat.
-/// @note This function assumes that the seat exists.
-/// @param event Event to get the seat index from.
-/// @param row Row of the seat.
-/// @param col Column of the seat.
-/// @return Index of the seat.
-static size_t seat_index(struct Event* event, size_t row, size_t col) { return (row - 1) * event->cols + col - 1; }
+/// Gets the event with the given ID from the state, without the simulated access delay.
+/// @note Only meant for replaying the log, which happens before any client is served.
+static struct Event* lookup_event_in_state(unsigned int event_id) { return lookup_event(event_list, event_id); }
+
+/// Gets the event with the given ID, from the calling thread's cache when possible.
+/// @note Only misses pay for get_event_with_delay. Missing events are not cached, as they may be created later.
+/// @param event_id The ID of the event to get.
+/// @return Pointer to the event if found, NULL otherwise.
+static struct Event* get_cached_event(unsigned int event_id) {
+  unsigned long generation = atomic_load(&state_generation);
+  if (event_cache.generation != generation) {
+    memset(&event_cache, 0, sizeof(event_cache));
+    event_cache.generation = generation;
+  }
+
+  size_t slot = event_id % EVENT_CACHE_SIZE;
+  if (event_cache.events[slot] != NULL && event_cache.ids[slot] == event_id) {
+    atomic_fetch_add_explicit(&cache_hits, 1, memory_order_relaxed);
+    return event_cache.events[slot];
+  }
+
+  atomic_fetch_add_explicit(&cache_misses, 1, memory_order_relaxed);
+  struct Event* event = get_event_with_delay(event_id);
+  if (event != NULL) {
+    event_cache.ids[slot] = event_id;
+    event_cache.events[slot] = event;
+  }
+  return event;
+}
+
+/// Locks the list rwl, counting the time spent waiting for it as lock wait.
+/// @param write Whether to lock it for writing rather than reading.
+/// @return 0 if the rwl was locked, an error number otherwise.
+static int lock_list(int write) {
+  uint64_t start = latency_now();
+  int ret = write ? pthread_rwlock_wrlock(&event_list->rwl) : pthread_rwlock_rdlock(&event_list->rwl);
+  latency_add(LATENCY_LOCK_WAIT, start);
+  return ret;
+}
+
+/// Registers an operation as pending, before it logs anything.
+/// @param op Pending operation, whose log offset is filled in.
+static void begin_pending(struct PendingOp* op) {
+  pthread_mutex_lock(&pending_mutex);
+  op->log_offset = wal_end();
+  op->prev = pending_tail;
+  op->next = NULL;
+  if (pending_tail != NULL) {
+    pending_tail->next = op;
+  } else {
+    pending_head = op;
+  }
+  pending_tail = op;
+  pthread_mutex_unlock(&pending_mutex);
+}
+
+/// Unregisters a pending operation, once its changes are in the state.
+static void end_pending(struct PendingOp* op) {
+  pthread_mutex_lock(&pending_mutex);
+  if (op->prev != NULL) {
+    op->prev->next = op->next;
+  } else {
+    pending_head = op->next;
+  }
+  if (op->next != NULL) {
+    op->next->prev = op->prev;
+  } else {
+    pending_tail = op->prev;
+  }
+  pthread_mutex_unlock(&pending_mutex);
+}
+
+/// Checks whether an event is being created by a pending CREATE.
+/// @note The caller must hold the list rwl.
+static int creation_pending(unsigned int event_id) {
+  if (num_pending_creates == 0) return 0;
+
+  pthread_mutex_lock(&pending_mutex);
+  struct PendingOp* op = pending_head;
+  while (op != NULL && (op->created == NULL || op->created->id != event_id)) op = op->next;
+  pthread_mutex_unlock(&pending_mutex);
+  return op != NULL;
+}
 
 int ems_init(unsigned int delay_us) {
   if (event_list != NULL) {
@@ -55,29 +170,50 @@ int ems_terminate() {
     return 1;
   }
 
-  free_list(event_list);
+  atomic_fetch_add(&state_generation, 1);
   pthread_rwlock_unlock(&event_list->rwl);
+  free_list(event_list);
+  event_list = NULL;
   return 0;
 }
 
-int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols) {
+/// Checks that every size derived from the dimensions of an event fits, which sparse storage no longer guarantees by
+/// running out of memory first.
+/// @return 1 if the dimensions are usable, 0 otherwise.
+static int valid_dimensions(size_t num_rows, size_t num_cols) {
+  if (num_rows > SIZE_MAX / sizeof(struct SeatTile**)) return 0;  // Tile table of a sparse event.
+  if (num_cols / SEAT_TILE_COLS > UINT_MAX) return 0;             // Tile index in a snapshot row.
+  return num_cols == 0 || num_rows <= SIZE_MAX / sizeof(unsigned int) / num_cols;  // Seats of a SHOW response.
+}
+
+/// Creates a new event and, unless it is being replayed, logs it.
+/// @param lookup Function used to check whether the event already exists.
+/// @param replaying Whether the event comes from the log, in which case it is not logged again.
+/// @return 0 if the event was created successfully, 1 otherwise.
+static int create(unsigned int event_id, size_t num_rows, size_t num_cols, struct Event* (*lookup)(unsigned int),
+                  int replaying) {
   if (event_list == NULL) {
     fprintf(stderr, "EMS state must be initialized\n");
     return 1;
   }
 
-  if (pthread_rwlock_wrlock(&event_list->rwl) != 0) {
+  if (!valid_dimensions(num_rows, num_cols)) {
+    fprintf(stderr, "Event dimensions are too large\n");
+    return 1;
+  }
+
+  if (lock_list(1) != 0) {
     fprintf(stderr, "Error locking list rwl\n");
     return 1;
   }
 
-  if (get_event_with_delay(event_id, event_list->head, event_list->tail) != NULL) {
+  if (lookup(event_id) != NULL || creation_pending(event_id)) {
     fprintf(stderr, "Event already exists\n");
     pthread_rwlock_unlock(&event_list->rwl);
     return 1;
   }
 
-  struct Event* event = malloc(sizeof(struct Event));
+  struct Event* event = create_event(event_list, event_id, num_rows, num_cols);
 
   if (event == NULL) {
     fprintf(stderr, "Error allocating memory for event\n");
@@ -85,202 +221,528 @@ int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols) {
     return 1;
   }
 
-  event->id = event_id;
-  event->rows = num_rows;
-  event->cols = num_cols;
-  event->reservations = 0;
-  if (pthread_mutex_init(&event->mutex, NULL) != 0) {
+  // Room is kept for every pending CREATE too, so appending the event once its record is durable cannot fail.
+  if (reserve_list_room(event_list, num_pending_creates + 1) != 0) {
+    fprintf(stderr, "Error appending event to list\n");
+    discard_event(event_list, event);
     pthread_rwlock_unlock(&event_list->rwl);
-    free(event);
     return 1;
   }
-  event->data = calloc(num_rows * num_cols, sizeof(unsigned int));
 
-  if (event->data == NULL) {
-    fprintf(stderr, "Error allocating memory for event data\n");
+  if (replaying) {
+    append_to_list(event_list, event);
     pthread_rwlock_unlock(&event_list->rwl);
-    free(event);
-    return 1;
+    return 0;
   }
 
-  if (append_to_list(event_list, event) != 0) {
-    fprintf(stderr, "Error appending event to list\n");
-    pthread_rwlock_unlock(&event_list->rwl);
-    free(event->data);
-    free(event);
-    return 1;
-  }
+  // The event only becomes visible once its record is durable, so its record precedes those of its reservations.
+  // The list rwl is not held while waiting for the fsync; the pending CREATE keeps the id taken meanwhile.
+  struct PendingOp pending = {.created = event};
+  begin_pending(&pending);
+  unsigned long lsn = wal_log_create(event_id, num_rows, num_cols);
+  num_pending_creates++;
+  pthread_rwlock_unlock(&event_list->rwl);
+
+  wal_commit(lsn);
 
+  lock_list(1);
+  num_pending_creates--;
+  end_pending(&pending);
+  append_to_list(event_list, event);
   pthread_rwlock_unlock(&event_list->rwl);
   return 0;
 }
 
-int ems_reserve(unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys) {
+int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols) {
+  latency_begin();
+  int ret = create(event_id, num_rows, num_cols, get_cached_event, 0);
+  latency_end(LATENCY_CREATE);
+  return ret;
+}
+
+/// Sets the result of every operation of a run.
+static void set_results(struct BatchOperation** ops, size_t num_ops, int result) {
+  for (size_t i = 0; i < num_ops; i++) {
+    ops[i]->result = result;
+  }
+}
+
+/// Sets the seats of every successful RESERVE of a run, marking them occupied or freeing them.
+/// @note The caller must hold the seat locks of the run. The seats were marked when they were claimed, so marking them
+/// again never needs memory.
+/// @param ids Reservation ID of each RESERVE, NULL to free the seats.
+static void set_seats(struct Event* event, struct BatchOperation** ops, size_t num_ops, const unsigned int* ids) {
+  for (size_t i = 0; i < num_ops; i++) {
+    struct BatchOperation* op = ops[i];
+    if (op->result != 0) continue;
+    for (size_t j = 0; j < op->num_seats; j++) {
+      mark_seat(event, op->xs[j], op->ys[j], ids != NULL);
+      set_seat(event, op->xs[j], op->ys[j], ids ? ids[i] : 0);
+    }
+  }
+}
+
+/// Stops the server when reservations that are already durable cannot be made visible, as they can no longer be
+/// withdrawn. Restarting replays them from the log.
+static _Noreturn void fail_logged_reservation(const char* message) {
+  fprintf(stderr, "%s, stopping the server\n", message);
+  exit(EXIT_FAILURE);
+}
+
+/// Reserves seats of an event for a run of RESERVEs and, unless it is being replayed, logs the reservations.
+/// @note The seat locks are taken and the seats published once for the whole run. Each RESERVE is still all or
+/// nothing and they are applied in order, so the results are those of making them one after another.
+/// @note Reservations only become visible once their records are durable.
+/// @param ops RESERVEs of the event, whose results are filled in.
+/// @param num_ops Number of RESERVEs.
+/// @param reservation_id Id of the reservation when replaying a single one, 0 to assign the next ones.
+static void reserve(struct Event* event, struct BatchOperation** ops, size_t num_ops, unsigned int reservation_id) {
+  int replaying = reservation_id != 0;
+
+  uint64_t stripes = 0;
+  size_t num_valid = 0, total_seats = 0;
+  for (size_t i = 0; i < num_ops; i++) {
+    struct BatchOperation* op = ops[i];
+    uint64_t op_stripes = 0;
+    op->result = op->num_seats > MAX_RESERVATION_SIZE;
+    if (op->result != 0) fprintf(stderr, "Too many seats in reservation\n");
+    for (size_t j = 0; j < op->num_seats && op->result == 0; j++) {
+      if (op->xs[j] <= 0 || op->xs[j] > event->rows || op->ys[j] <= 0 || op->ys[j] > event->cols) {
+        fprintf(stderr, "Seat out of bounds\n");
+        op->result = 1;
+        break;
+      }
+      op_stripes |= row_stripe(event, op->xs[j]);
+    }
+    if (op->result == 0) {
+      stripes |= op_stripes;
+      num_valid++;
+      total_seats += op->num_seats;
+    }
+  }
+  if (num_valid == 0) return;
+
+  // Only the row blocks touched by the run are locked, so disjoint reservations run in parallel.
+  uint64_t lock_start = latency_now();
+  int locked = lock_stripes(event, stripes);
+  latency_add(LATENCY_LOCK_WAIT, lock_start);
+  if (locked != 0) {
+    fprintf(stderr, "Error locking mutex\n");
+    set_results(ops, num_ops, 1);
+    return;
+  }
+
+  // Marking seats as they are checked also catches seats repeated within a request or taken earlier in the run.
+  unsigned int ids[num_ops];
+  size_t changed_rows[total_seats + 1];  // One more, so it is never empty.
+  size_t num_changed = 0, num_reserved = 0;
+  for (size_t i = 0; i < num_ops; i++) {
+    struct BatchOperation* op = ops[i];
+    if (op->result != 0) continue;
+
+    size_t claimed = 0;
+    for (; claimed < op->num_seats; claimed++) {
+      if (seat_occupied(event, op->xs[claimed], op->ys[claimed])) {
+        fprintf(stderr, "Seat already reserved\n");
+        break;
+      }
+      if (mark_seat(event, op->xs[claimed], op->ys[claimed], 1) != 0) {
+        fprintf(stderr, "Error allocating memory for seats\n");
+        break;
+      }
+    }
+
+    if (claimed < op->num_seats) {
+      for (size_t j = 0; j < claimed; j++) {
+        mark_seat(event, op->xs[j], op->ys[j], 0);
+      }
+      op->result = 1;
+      continue;
+    }
+
+    if (reservation_id == 0) {
+      ids[i] = atomic_fetch_add(&event->reservations, 1) + 1;
+    } else {
+      ids[i] = reservation_id;
+      if (atomic_load(&event->reservations) < reservation_id) atomic_store(&event->reservations, reservation_id);
+    }
+
+    memcpy(changed_rows + num_changed, op->xs, op->num_seats * sizeof(size_t));
+    num_changed += op->num_seats;
+    num_reserved++;
+  }
+
+  if (num_reserved == 0) {
+    unlock_stripes(event, stripes);
+    return;
+  }
+
+  // Logged under the stripe locks, so reservations of the same seats are logged in the order they were made.
+  // Records are flushed in order, so waiting for the last one of the run covers all of them.
+  struct PendingOp pending = {.created = NULL};
+  unsigned long lsn = 0;
+  if (!replaying) begin_pending(&pending);
+  for (size_t i = 0; i < num_ops && !replaying; i++) {
+    struct BatchOperation* op = ops[i];
+    if (op->result == 0) lsn = wal_log_reserve(event->id, ids[i], op->num_seats, op->xs, op->ys);
+  }
+
+  // The claimed seats are only marked occupied until the records are durable, without their ids, so snapshots
+  // published meanwhile for other seats of the same rows do not show them. Only the wait for the fsync happens
+  // after unlocking, where it is shared with other workers.
+  if (lsn != 0) {
+    unlock_stripes(event, stripes);
+    wal_commit(lsn);
+    lock_start = latency_now();
+    locked = lock_stripes(event, stripes);
+    latency_add(LATENCY_LOCK_WAIT, lock_start);
+    if (locked != 0) fail_logged_reservation("Error locking mutex");
+  }
+
+  // Readers only ever see the seats through snapshots, so the reservations are not visible until this succeeds.
+  set_seats(event, ops, num_ops, ids);
+  if (publish_snapshot(event, num_changed, changed_rows) != 0) {
+    if (lsn != 0) fail_logged_reservation("Error publishing seat snapshot");
+    fprintf(stderr, "Error publishing seat snapshot\n");
+    set_seats(event, ops, num_ops, NULL);
+    set_results(ops, num_ops, 1);
+  }
+  unlock_stripes(event, stripes);
+  if (!replaying) end_pending(&pending);
+}
+
+/// Reserves seats of the event with the given ID.
+/// @return 0 if the reservation was created successfully, 1 otherwise.
+static int reserve_seats(unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys) {
   if (event_list == NULL) {
     fprintf(stderr, "EMS state must be initialized\n");
     return 1;
   }
 
-  if (pthread_rwlock_rdlock(&event_list->rwl) != 0) {
-    fprintf(stderr, "Error locking list rwl\n");
+  struct Event* event = get_cached_event(event_id);
+
+  if (event == NULL) {
+    fprintf(stderr, "Event not found\n");
     return 1;
   }
 
-  struct Event* event = get_event_with_delay(event_id, event_list->head, event_list->tail);
+  struct BatchOperation op = {.op_code = '4', .event_id = event_id, .num_seats = num_seats, .xs = xs, .ys = ys};
+  struct BatchOperation* ops[] = {&op};
+  reserve(event, ops, 1, 0);
+  return op.result;
+}
 
-  pthread_rwlock_unlock(&event_list->rwl);
+int ems_reserve(unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys) {
+  latency_begin();
+  int ret = reserve_seats(event_id, num_seats, xs, ys);
+  latency_end(LATENCY_RESERVE);
+  return ret;
+}
 
-  if (event == NULL) {
-    fprintf(stderr, "Event not found\n");
-    return 1;
+/// Runs the operations of a batch grouped by event.
+static void run_batch(struct BatchOperation* ops, size_t num_ops) {
+  if (event_list == NULL) {
+    fprintf(stderr, "EMS state must be initialized\n");
+    for (size_t i = 0; i < num_ops; i++) {
+      ops[i].result = 1;
+    }
+    return;
   }
 
-  if (pthread_mutex_lock(&event->mutex) != 0) {
-    fprintf(stderr, "Error locking mutex\n");
-    return 1;
+  // Operations of different events do not affect each other, so a stable sort by event keeps the results of
+  // running them in order while turning the RESERVEs of each event into one run.
+  struct BatchOperation* sorted[num_ops];
+  for (size_t i = 0; i < num_ops; i++) {
+    size_t j = i;
+    for (; j > 0 && sorted[j - 1]->event_id > ops[i].event_id; j--) {
+      sorted[j] = sorted[j - 1];
+    }
+    sorted[j] = &ops[i];
   }
 
-  for (size_t i = 0; i < num_seats; i++) {
-    if (xs[i] <= 0 || xs[i] > event->rows || ys[i] <= 0 || ys[i] > event->cols) {
-      fprintf(stderr, "Seat out of bounds\n");
-      pthread_mutex_unlock(&event->mutex);
-      return 1;
+  for (size_t start = 0, end; start < num_ops; start = end) {
+    struct BatchOperation* first = sorted[start];
+    end = start + 1;
+    if (first->op_code == '3') {
+      first->result = create(first->event_id, first->num_rows, first->num_cols, get_cached_event, 0);
+      continue;
+    }
+
+    while (end < num_ops && sorted[end]->event_id == first->event_id && sorted[end]->op_code == '4') end++;
+    struct Event* event = get_cached_event(first->event_id);
+    if (event == NULL) {
+      fprintf(stderr, "Event not found\n");
+      set_results(sorted + start, end - start, 1);
+    } else {
+      reserve(event, sorted + start, end - start, 0);
     }
   }
+}
 
-  for (size_t i = 0; i < event->rows * event->cols; i++) {
-    for (size_t j = 0; j < num_seats; j++) {
-      if (seat_index(event, xs[j], ys[j]) != i) {
-        continue;
-      }
+void ems_batch(struct BatchOperation* ops, size_t num_ops) {
+  latency_begin();
+  run_batch(ops, num_ops);
+  latency_end(LATENCY_BATCH);
+}
 
-      if (event->data[i] != 0) {
-        fprintf(stderr, "Seat already reserved\n");
-        pthread_mutex_unlock(&event->mutex);
-        return 1;
-      }
+/// Replays a logged event creation, without the simulated access delay.
+static int replay_create(unsigned int event_id, size_t num_rows, size_t num_cols) {
+  // Checkpoints may already hold operations logged after their log offset.
+  if (lookup_event_in_state(event_id) != NULL) return 0;
+  return create(event_id, num_rows, num_cols, lookup_event_in_state, 1);
+}
 
-      break;
-    }
+/// Replays a logged reservation with its original id, without the simulated access delay.
+static int replay_reserve(unsigned int event_id, unsigned int reservation_id, size_t num_seats, size_t* xs,
+                          size_t* ys) {
+  struct Event* event = lookup_event_in_state(event_id);
+
+  if (event == NULL) {
+    fprintf(stderr, "Event not found\n");
+    return 1;
   }
 
-  unsigned int reservation_id = ++event->reservations;
+  // Reservations are all or nothing, so one seat tells whether the checkpoint already holds it.
+  if (num_seats > 0 && xs[0] > 0 && xs[0] <= event->rows && ys[0] > 0 && ys[0] <= event->cols &&
+      get_seat(event, xs[0], ys[0]) == reservation_id) {
+    return 0;
+  }
+
+  struct BatchOperation op = {.op_code = '4', .event_id = event_id, .num_seats = num_seats, .xs = xs, .ys = ys};
+  struct BatchOperation* ops[] = {&op};
+  reserve(event, ops, 1, reservation_id);
+  return op.result;
+}
 
-  for (size_t i = 0; i < num_seats; i++) {
-    event->data[seat_index(event, xs[i], ys[i])] = reservation_id;
+int ems_open_log(const char* path, int async) {
+  if (event_list == NULL) {
+    fprintf(stderr, "EMS state must be initialized\n");
+    return 1;
   }
 
-  pthread_mutex_unlock(&event->mutex);
-  return 0;
+  struct WalHandlers handlers = {.create = replay_create, .reserve = replay_reserve};
+  if (wal_replay(path, log_replay_start, &handlers) != 0) {
+    fprintf(stderr, "Error replaying log\n");
+    return 1;
+  }
+
+  return wal_open(path, async);
 }
 
-int ems_show(int out_fd, unsigned int event_id) {
-  int ret;
+int ems_load_checkpoint(const char* path) {
   if (event_list == NULL) {
     fprintf(stderr, "EMS state must be initialized\n");
-    ret = 1;
-    write(out_fd, &ret, sizeof(int));
     return 1;
   }
 
-  if (pthread_rwlock_rdlock(&event_list->rwl) != 0) {
+  if (pthread_rwlock_wrlock(&event_list->rwl) != 0) {
     fprintf(stderr, "Error locking list rwl\n");
-    ret = 1;
-    write(out_fd, &ret, sizeof(int));
     return 1;
   }
 
-  struct Event* event = get_event_with_delay(event_id, event_list->head, event_list->tail);
+  if (event_list->head != NULL) {
+    fprintf(stderr, "Checkpoints can only be loaded into an empty state\n");
+    pthread_rwlock_unlock(&event_list->rwl);
+    return 1;
+  }
 
+  int ret = checkpoint_load(event_list, path, &log_replay_start);
   pthread_rwlock_unlock(&event_list->rwl);
+  return ret;
+}
 
-  if (event == NULL) {
-    fprintf(stderr, "Event not found\n");
-    ret = 1;
-    write(out_fd, &ret, sizeof(int));
+int ems_checkpoint(const char* path) {
+  if (event_list == NULL) {
+    fprintf(stderr, "EMS state must be initialized\n");
     return 1;
   }
 
-  if (pthread_mutex_lock(&event->mutex) != 0) {
-    fprintf(stderr, "Error locking mutex\n");
-    ret = 1;
-    write(out_fd, &ret, sizeof(int));
-    return 1;
+  // CREATEs and RESERVEs still waiting for their records are not in the state yet, so the log is replayed from the
+  // oldest of them. Everything logged before this offset is already in the state that gets written.
+  pthread_mutex_lock(&pending_mutex);
+  size_t log_offset = pending_head != NULL ? pending_head->log_offset : wal_end();
+  pthread_mutex_unlock(&pending_mutex);
+
+  // The log must hold everything the checkpoint skips before the checkpoint replaces the old one.
+  wal_flush();
+
+  return checkpoint_write(event_list, path, log_offset);
+}
+
+/// Writes a response to a file descriptor, or to a shared-memory response ring.
+/// @param out_fd File descriptor to write to. With a ring, socket to the client, which ends the wait for room if it
+/// hangs up.
+/// @param ring Response ring to write to, NULL to write to out_fd.
+/// @return 0 if the whole response was written, 1 otherwise.
+static int respond(int out_fd, struct Ring* ring, const void* data, size_t len) {
+  if (ring != NULL) return ring_write(ring, data, len, out_fd);
+  return write(out_fd, data, len) != (ssize_t)len;
+}
+
+/// Writes a pinned snapshot of an event as a response in a ring.
+/// @note Rows are copied from the snapshot straight into the ring, through a buffer only when they wrap around its end.
+/// @param peer_fd Socket to the client, which ends the wait for room if it hangs up.
+/// @return 0 if the event was written successfully, 1 otherwise.
+static int show_into_ring(int peer_fd, struct Ring* ring, struct Event* event, struct SeatSnapshot* snapshot) {
+  int ret = 0;
+  char header[sizeof(int) + sizeof(size_t) * 2];
+  memcpy(header, &ret, sizeof(int));
+  memcpy(header + sizeof(int), &event->rows, sizeof(size_t));
+  memcpy(header + sizeof(int) + sizeof(size_t), &event->cols, sizeof(size_t));
+  if (ring_write(ring, header, sizeof(header), peer_fd) != 0) return 1;
+
+  // Every response is made of 4-byte words, so rows claimed in the ring are aligned for copy_snapshot_row.
+  size_t row_size = sizeof(unsigned int) * event->cols;
+  unsigned int* row = NULL;
+  for (size_t i = 1; i <= event->rows; i++) {
+    char* dest = ring_claim(ring, row_size, peer_fd);
+    if (dest != NULL) {
+      copy_snapshot_row(event, snapshot, i, (unsigned int*)dest);
+      ring_commit(ring, row_size);
+      continue;
+    }
+
+    if (row == NULL && (row = malloc(row_size)) == NULL) {
+      fprintf(stderr, "Error allocating memory for event data\n");
+      return 1;
+    }
+    copy_snapshot_row(event, snapshot, i, row);
+    if (ring_write(ring, row, row_size, peer_fd) != 0) {
+      free(row);
+      return 1;
+    }
+  }
+
+  free(row);
+  return 0;
+}
+
+/// Writes an event's seats, or the error, as a response.
+/// @param ring Response ring to write to, NULL to write to out_fd.
+/// @return 0 if the whole response was written, 1 otherwise.
+static int show(int out_fd, struct Ring* ring, unsigned int event_id) {
+  int ret = 1;
+  if (event_list == NULL) {
+    fprintf(stderr, "EMS state must be initialized\n");
+    return respond(out_fd, ring, &ret, sizeof(int));
+  }
+
+  struct Event* event = get_cached_event(event_id);
+
+  if (event == NULL) {
+    fprintf(stderr, "Event not found\n");
+    return respond(out_fd, ring, &ret, sizeof(int));
   }
 
+  // The pinned snapshot is immutable, so copying it never holds up reservations on the event.
+  uint64_t pin_start = latency_now();
+  struct SeatSnapshot* snapshot = pin_snapshot(event);
+  latency_add(LATENCY_LOCK_WAIT, pin_start);
+
   size_t num_rows = event->rows;
   size_t num_cols = event->cols;
-  unsigned int seats[num_rows*num_cols];
-  for (size_t i = 1; i <= event->rows; i++) {
-    for (size_t j = 1; j <= event->cols; j++) {
-      seats[seat_index(event, i, j)] = event->data[seat_index(event, i, j)];
-    }
+  size_t row_size = sizeof(unsigned int) * num_cols;
+  if (ring != NULL) {
+    int failed = show_into_ring(out_fd, ring, event, snapshot);
+    unpin_snapshot(event, snapshot);
+    return failed;
   }
 
-  pthread_mutex_unlock(&event->mutex);
+  // Rows are copied one at a time into a writer, so a huge sparse venue is never laid out densely in memory.
+  unsigned int* row = malloc(row_size ? row_size : 1);
+  if (row == NULL) {
+    fprintf(stderr, "Error allocating memory for event data\n");
+    unpin_snapshot(event, snapshot);
+    return respond(out_fd, ring, &ret, sizeof(int));
+  }
 
+  struct Writer writer;
+  writer_init(&writer, out_fd);
   ret = 0;
-  char msg[sizeof(int) + sizeof(size_t)*2 + sizeof(unsigned int)*num_cols*num_rows];
-  memcpy(msg, &ret, sizeof(int));
-  memcpy(msg + sizeof(int), &num_rows, sizeof(size_t));
-  memcpy(msg + sizeof(int) + sizeof(size_t), &num_cols, sizeof(size_t));
-  memcpy(msg + sizeof(int) + sizeof(size_t)*2, seats, sizeof(unsigned int)*num_cols*num_rows);
-  write(out_fd, msg, sizeof(int) + sizeof(size_t)*2 + sizeof(unsigned int)*num_cols*num_rows);
+  writer_bytes(&writer, &ret, sizeof(int));
+  writer_bytes(&writer, &num_rows, sizeof(size_t));
+  writer_bytes(&writer, &num_cols, sizeof(size_t));
+  for (size_t i = 1; i <= num_rows && !writer.failed; i++) {
+    copy_snapshot_row(event, snapshot, i, row);
+    writer_bytes(&writer, row, row_size);
+  }
 
-  return 0;
+  unpin_snapshot(event, snapshot);
+  free(row);
+  return writer_flush(&writer);
 }
 
-int ems_list_events(int out_fd) {
-  int ret;
+int ems_show(int out_fd, unsigned int event_id) {
+  latency_begin();
+  int ret = show(out_fd, NULL, event_id);
+  latency_end(LATENCY_SHOW);
+  return ret;
+}
+
+int ems_show_ring(struct Ring* ring, int peer_fd, unsigned int event_id) {
+  latency_begin();
+  int ret = show(peer_fd, ring, event_id);
+  latency_end(LATENCY_SHOW);
+  return ret;
+}
+
+/// Writes the ids of every event, or the error, as a response.
+/// @param ring Response ring to write to, NULL to write to out_fd.
+/// @return 0 if the whole response was written, 1 otherwise.
+static int list_events(int out_fd, struct Ring* ring) {
+  int ret = 1;
   if (event_list == NULL) {
     fprintf(stderr, "EMS state must be initialized\n");
-    ret = 1;
-    write(out_fd, &ret, sizeof(int));
-    return 1;
+    return respond(out_fd, ring, &ret, sizeof(int));
   }
 
-  if (pthread_rwlock_rdlock(&event_list->rwl) != 0) {
+  if (lock_list(0) != 0) {
     fprintf(stderr, "Error locking list rwl\n");
-    ret = 1;
-    write(out_fd, &ret, sizeof(int));
-    return 1;
+    return respond(out_fd, ring, &ret, sizeof(int));
   }
 
+  // Events are only appended, so the ones up to the current tail can be counted and then copied.
   struct ListNode* to = event_list->tail;
-  struct ListNode* current = event_list->head;
   size_t num_events = 0;
-  unsigned int buffer[MAX_RESERVATION_SIZE];
+  for (struct ListNode* current = event_list->head; current != NULL; current = current->next) {
+    num_events++;
+    if (current == to) break;
+  }
 
-  if (current == NULL) {
+  size_t header_size = sizeof(int) + sizeof(size_t);
+  char* msg = malloc(header_size + sizeof(unsigned int) * num_events);
+  if (msg == NULL) {
     pthread_rwlock_unlock(&event_list->rwl);
-    ret = 0;
-    write(out_fd, &ret, sizeof(int));
-    write(out_fd, &num_events, sizeof(size_t));
-    return 0;
+    fprintf(stderr, "Error allocating memory for event ids\n");
+    return respond(out_fd, ring, &ret, sizeof(int));
   }
-  
-  while (1) {
-    buffer[num_events++] = (current->event)->id;
 
-    if (current == to) {
-      break;
-    }
-    current = current->next;
-  }
+  struct ListNode* current = event_list->head;
+  for (size_t i = 0; i < num_events; i++, current = current->next)
+    memcpy(msg + header_size + sizeof(unsigned int) * i, &(current->event)->id, sizeof(unsigned int));
 
   pthread_rwlock_unlock(&event_list->rwl);
 
-  unsigned int event_ids[num_events];
-  for (size_t i = 0; i < num_events; i++)
-    event_ids[i] = buffer[i];
-  
   ret = 0;
-  char msg[sizeof(int) + sizeof (size_t) + sizeof(unsigned int)*num_events];
   memcpy(msg, &ret, sizeof(int));
   memcpy(msg + sizeof(int), &num_events, sizeof(size_t));
-  memcpy(msg + sizeof(int) + sizeof(size_t), event_ids, sizeof(unsigned int)*num_events);
-  write(out_fd, msg, sizeof(int) + sizeof (size_t) + sizeof(unsigned int)*num_events);
-  return 0;
+  int failed = respond(out_fd, ring, msg, header_size + sizeof(unsigned int) * num_events);
+  free(msg);
+  return failed;
+}
+
+int ems_list_events(int out_fd) {
+  latency_begin();
+  int ret = list_events(out_fd, NULL);
+  latency_end(LATENCY_LIST);
+  return ret;
+}
+
+int ems_list_events_ring(struct Ring* ring, int peer_fd) {
+  latency_begin();
+  int ret = list_events(peer_fd, ring);
+  latency_end(LATENCY_LIST);
+  return ret;
 }
 
 int ems_show_all_events() {
@@ -303,24 +765,33 @@ int ems_show_all_events() {
     return 0;
   }
 
-  while (1) {
-    printf("Event: %u\n", (current->event)->id);
+  // Output goes straight to stdout's file descriptor, after whatever stdio still holds.
+  fflush(stdout);
+  struct Writer writer;
+  writer_init(&writer, STDOUT_FILENO);
 
-    if (pthread_mutex_lock(&(current->event)->mutex) != 0) {
-      fprintf(stderr, "Error locking mutex\n");
-      return 1;
+  int result = 0;
+  while (1) {
+    writer_str(&writer, "Event: ");
+    writer_uint(&writer, (current->event)->id);
+    writer_str(&writer, "\n");
+
+    unsigned int* row = malloc(((current->event)->cols ? (current->event)->cols : 1) * sizeof(unsigned int));
+    if (row == NULL) {
+      fprintf(stderr, "Error allocating memory for event data\n");
+      result = 1;
+      break;
     }
 
+    struct SeatSnapshot* snapshot = pin_snapshot(current->event);
+
     for (size_t i = 1; i <= (current->event)->rows; i++) {
-      for (size_t j = 1; j <= (current->event)->cols; j++) {
-        printf("%u", (current->event)->data[seat_index((current->event), i, j)]);
-        if (j < (current->event)->cols)
-          printf(" ");
-      }
-      printf("\n");
+      copy_snapshot_row(current->event, snapshot, i, row);
+      writer_row(&writer, row, (current->event)->cols);
     }
 
-    pthread_mutex_unlock(&(current->event)->mutex);
+    unpin_snapshot(current->event, snapshot);
+    free(row);
 
     if (current == to) {
       break;
@@ -329,5 +800,46 @@ int ems_show_all_events() {
   }
 
   pthread_rwlock_unlock(&event_list->rwl);
+  if (writer_flush(&writer) != 0) {
+    fprintf(stderr, "Error writing events\n");
+    result = 1;
+  }
+  return result;
+}
+
+void ems_cache_stats(size_t* hits, size_t* misses) {
+  *hits = atomic_load(&cache_hits);
+  *misses = atomic_load(&cache_misses);
+}
+
+int ems_memory_report(FILE* out) {
+  if (event_list == NULL) {
+    fprintf(stderr, "EMS state must be initialized\n");
+    return 1;
+  }
+
+  if (pthread_rwlock_rdlock(&event_list->rwl) != 0) {
+    fprintf(stderr, "Error locking list rwl\n");
+    return 1;
+  }
+
+  size_t total_seat_bytes = 0, total_snapshot_bytes = 0;
+  for (struct ListNode* current = event_list->head; current != NULL; current = current->next) {
+    struct Event* event = current->event;
+    struct SeatSnapshot* snapshot = pin_snapshot(event);
+    size_t seat_bytes = atomic_load(&event->seat_bytes);
+    size_t snapshot_size = snapshot_bytes(event, snapshot);
+    unpin_snapshot(event, snapshot);
+
+    fprintf(out, "Event %u: %zux%zu %s, %zu seat bytes, %zu snapshot bytes\n", event->id, event->rows, event->cols,
+           event->sparse ? "sparse" : "dense", seat_bytes, snapshot_size);
+    total_seat_bytes += seat_bytes;
+    total_snapshot_bytes += snapshot_size;
+  }
+
+  pthread_rwlock_unlock(&event_list->rwl);
+  fprintf(out, "Total: %zu seat bytes, %zu snapshot bytes\n", total_seat_bytes, total_snapshot_bytes);
   return 0;
-}
\ No newline at end of file
+}
+
+void ems_latency_report(FILE* out) { latency_report(out, latency_names, NUM_LATENCY_OPS); }
@@ -2,12 +2,32 @@
 #define SERVER_OPERATIONS_H
 
 #include <stddef.h>
+#include <stdio.h>
+
+struct Ring;
 
 /// Initializes the EMS state.
 /// @param delay_us Delay in microseconds.
 /// @return 0 if the EMS state was initialized successfully, 1 otherwise.
 int ems_init(unsigned int delay_us);
 
+/// Replays the write-ahead log into the EMS state, then logs every later CREATE and RESERVE to it.
+/// @param path Path to the log, created if missing.
+/// @param async 0 to reply to clients only once their operation is on disk, 1 to sync the log in the background.
+/// @return 0 if the log was replayed and opened successfully, 1 otherwise.
+int ems_open_log(const char *path, int async);
+
+/// Loads a checkpoint into the still empty EMS state, mapping its seats instead of reading them.
+/// @note Must be called before ems_open_log, which then only replays what the checkpoint does not hold.
+/// @param path Path to the checkpoint. A missing checkpoint loads nothing.
+/// @return 0 if the checkpoint was loaded successfully, 1 otherwise.
+int ems_load_checkpoint(const char *path);
+
+/// Writes a checkpoint of the EMS state, while clients keep being served.
+/// @param path Path to the checkpoint, replaced atomically.
+/// @return 0 if the checkpoint was written successfully, 1 otherwise.
+int ems_checkpoint(const char *path);
+
 /// Destroys the EMS state.
 int ems_terminate();
 
@@ -26,19 +46,63 @@ int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols);
 /// @return 0 if the reservation was created successfully, 1 otherwise.
 int ems_reserve(unsigned int event_id, size_t num_seats, size_t *xs, size_t *ys);
 
-/// Prints the given event.
-/// @param out_fd File descriptor to print the event to.
-/// @param event_id Id of the event to print.
-/// @return 0 if the event was printed successfully, 1 otherwise.
+// A CREATE or RESERVE of a batch.
+struct BatchOperation {
+  char op_code;                // '3' for a CREATE, '4' for a RESERVE.
+  unsigned int event_id;
+  size_t num_rows, num_cols;  // Dimensions of a CREATE.
+  size_t num_seats;            // Seats of a RESERVE, and their rows and columns.
+  size_t *xs, *ys;
+  int result;  // 0 if the operation succeeded, 1 otherwise, once the batch ran.
+};
+
+/// Runs a batch of CREATEs and RESERVEs, with the results of running them one after another.
+/// @note Operations are grouped by event, so the seat locks of an event are taken and its seats published once for
+/// each run of RESERVEs of it, and their log records share one commit.
+/// @param ops Operations of the batch, whose results are filled in.
+/// @param num_ops Number of operations.
+void ems_batch(struct BatchOperation *ops, size_t num_ops);
+
+/// Writes the given event, or the error, as a response.
+/// @param out_fd File descriptor to write the response to.
+/// @param event_id Id of the event to write.
+/// @return 0 if the whole response was written, even one reporting an error, 1 otherwise.
 int ems_show(int out_fd, unsigned int event_id);
 
-/// Prints all the events.
-/// @param out_fd File descriptor to print the events to.
-/// @return 0 if the events were printed successfully, 1 otherwise.
+/// Writes the ids of all the events, or the error, as a response.
+/// @param out_fd File descriptor to write the response to.
+/// @return 0 if the whole response was written, even one reporting an error, 1 otherwise.
 int ems_list_events(int out_fd);
 
+/// Writes the given event into the response ring of a shared-memory session.
+/// @param ring Response ring to write the event to.
+/// @param peer_fd Socket to the client, which ends the wait for room in the ring if it hangs up.
+/// @param event_id Id of the event to write.
+/// @return 0 if the whole response was written, even one reporting an error, 1 otherwise.
+int ems_show_ring(struct Ring *ring, int peer_fd, unsigned int event_id);
+
+/// Writes the ids of all the events into the response ring of a shared-memory session.
+/// @param ring Response ring to write the ids to.
+/// @param peer_fd Socket to the client, which ends the wait for room in the ring if it hangs up.
+/// @return 0 if the whole response was written, even one reporting an error, 1 otherwise.
+int ems_list_events_ring(struct Ring *ring, int peer_fd);
+
 /// Prints the state of all events.
 /// @return 0 if the events were printed successfully, 1 otherwise.
 int ems_show_all_events();
 
+/// Prints the memory used by the seats and the latest snapshot of every event.
+/// @param out File to print the report to.
+/// @return 0 if the report was printed successfully, 1 otherwise.
+int ems_memory_report(FILE *out);
+
+/// Gets the counters of the per-thread event handle caches.
+/// @param hits Pointer to the variable to store the number of lookups served from a cache in.
+/// @param misses Pointer to the variable to store the number of lookups that went to the state in.
+void ems_cache_stats(size_t *hits, size_t *misses);
+
+/// Prints p50/p90/p99/max latencies per operation and phase, merged over every worker thread.
+/// @param out File to print the report to.
+void ems_latency_report(FILE *out);
+
 #endif  // SERVER_OPERATIONS_H
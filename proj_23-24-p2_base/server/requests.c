@@ -0,0 +1,301 @@
+#include "requests.h"
+
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "operations.h"
+
+_Static_assert(MAX_BATCH_SIZE <= MAX_REQUEST_SIZE, "batches are buffered like any other request");
+
+/// Works out the size of the arguments of a CREATE or RESERVE, like request_size does for whole requests.
+/// @param op_code Op code of the operation.
+/// @param args Bytes of the arguments received so far.
+/// @param len Number of bytes received so far.
+/// @return Number of bytes of arguments needed to go on, -1 if the operation is invalid.
+static ssize_t operation_args_size(char op_code, const char* args, size_t len) {
+  switch (op_code) {
+    case '3':
+      return sizeof(unsigned int) + sizeof(size_t) * 2;
+
+    case '4': {
+      size_t fixed = sizeof(unsigned int) + sizeof(size_t);
+      if (len < fixed) return (ssize_t)fixed;
+
+      size_t num_seats;
+      memcpy(&num_seats, args + sizeof(unsigned int), sizeof(size_t));
+      if (num_seats > MAX_RESERVATION_SIZE) return -1;
+      return (ssize_t)(fixed + sizeof(size_t) * 2 * num_seats);
+    }
+
+    default:
+      return -1;
+  }
+}
+
+/// Works out the size of a batch request, walking its operations as far as they were received.
+/// @return Number of bytes needed to go on, -1 if the batch is invalid.
+static ssize_t batch_size(const char* data, size_t len) {
+  size_t size = REQUEST_HEADER_SIZE + sizeof(size_t);
+  if (len < size) return (ssize_t)size;
+
+  size_t num_ops;
+  memcpy(&num_ops, data + REQUEST_HEADER_SIZE, sizeof(size_t));
+  if (num_ops == 0 || num_ops > MAX_BATCH_OPERATIONS) return -1;
+
+  for (size_t i = 0; i < num_ops; i++) {
+    size_t needed = size + sizeof(char);
+    if (len >= needed) {
+      ssize_t args = operation_args_size(data[size], data + needed, len - needed);
+      if (args < 0) return -1;
+      needed += (size_t)args;
+    }
+    if (needed > MAX_BATCH_SIZE) return -1;
+    if (len < needed) return (ssize_t)needed;
+    size = needed;
+  }
+  return (ssize_t)size;
+}
+
+ssize_t request_size(const char* data, size_t len) {
+  if (len == 0) return 1;
+  if ((unsigned char)data[0] == FRAME_VERSION) return frame_size(data, len);
+  if (len < REQUEST_HEADER_SIZE) return REQUEST_HEADER_SIZE;
+
+  switch (data[0]) {
+    case '2':
+    case '6':
+    case '7':
+      return REQUEST_HEADER_SIZE;
+
+    case '3':
+    case '4': {
+      ssize_t args = operation_args_size(data[0], data + REQUEST_HEADER_SIZE, len - REQUEST_HEADER_SIZE);
+      return args < 0 ? -1 : (ssize_t)REQUEST_HEADER_SIZE + args;
+    }
+
+    case '5':
+      return REQUEST_HEADER_SIZE + sizeof(unsigned int);
+
+    case '8':
+      return batch_size(data, len);
+
+    default:
+      return -1;
+  }
+}
+
+/// Writes a response to a file descriptor, or to a shared-memory response ring.
+/// @note A response cut short leaves the client unable to tell where the next one starts, so the session ends.
+/// @return 0 if the session goes on, 1 if the client went away or stopped reading.
+static int respond(const void* data, size_t len, int fd_resp, struct Ring* ring_resp) {
+  if (ring_resp != NULL) return ring_write(ring_resp, data, len, fd_resp);
+  return write(fd_resp, data, len) != (ssize_t)len;
+}
+
+/// Writes the return code of a request, like respond.
+static int respond_ret(int ret, int fd_resp, struct Ring* ring_resp) {
+  return respond(&ret, sizeof(int), fd_resp, ring_resp);
+}
+
+// A request of either version, decoded.
+struct Request {
+  char op_code;
+  uint64_t client_id;
+  unsigned int event_id;  // Event of a SHOW.
+  size_t num_ops;         // CREATEs and RESERVEs, one unless the request is a batch.
+  struct BatchOperation ops[MAX_BATCH_OPERATIONS];
+  size_t seats[2 * MAX_BATCH_SEATS];  // Rows and columns of every RESERVE, aligned.
+};
+
+/// Decodes a CREATE or RESERVE of version 1, already checked by request_size.
+/// @param seats Where to keep the rows and columns of a RESERVE.
+/// @return Number of bytes of arguments decoded.
+static size_t decode_v1_operation(char op_code, const char* args, struct BatchOperation* op, size_t* seats) {
+  op->op_code = op_code;
+  memcpy(&op->event_id, args, sizeof(unsigned int));
+  args += sizeof(unsigned int);
+  if (op_code == '3') {
+    memcpy(&op->num_rows, args, sizeof(size_t));
+    memcpy(&op->num_cols, args + sizeof(size_t), sizeof(size_t));
+    return sizeof(unsigned int) + sizeof(size_t) * 2;
+  }
+
+  // Rows come right before columns, so both are copied at once.
+  memcpy(&op->num_seats, args, sizeof(size_t));
+  op->xs = seats;
+  op->ys = seats + op->num_seats;
+  memcpy(seats, args + sizeof(size_t), sizeof(size_t) * 2 * op->num_seats);
+  return sizeof(unsigned int) + sizeof(size_t) * (2 * op->num_seats + 1);
+}
+
+/// Decodes a request of version 1, already checked by request_size.
+static void decode_v1(const char* data, struct Request* request) {
+  int client_id;
+  memcpy(&client_id, data + sizeof(char), sizeof(int));
+  request->op_code = data[0];
+  request->client_id = (uint64_t)client_id;
+  request->num_ops = 0;
+
+  const char* args = data + REQUEST_HEADER_SIZE;
+  switch (request->op_code) {
+    case '3':
+    case '4':
+      request->num_ops = 1;
+      decode_v1_operation(request->op_code, args, &request->ops[0], request->seats);
+      break;
+
+    case '5':
+      memcpy(&request->event_id, args, sizeof(unsigned int));
+      break;
+
+    case '8': {
+      memcpy(&request->num_ops, args, sizeof(size_t));
+      args += sizeof(size_t);
+      size_t used = 0;
+      for (size_t i = 0; i < request->num_ops; i++) {
+        char op_code = *args++;
+        args += decode_v1_operation(op_code, args, &request->ops[i], request->seats + used);
+        used += 2 * request->ops[i].num_seats;
+      }
+      break;
+    }
+
+    default:
+      break;
+  }
+}
+
+/// Reads a number of a frame, checking it is at most the given maximum.
+/// @return 0 if the number was read, 1 otherwise.
+static int get_number(const char** cursor, const char* end, uint64_t max, uint64_t* value) {
+  return varint_get(cursor, end, value) != 0 || *value > max;
+}
+
+/// Decodes a CREATE or RESERVE of a frame.
+/// @param seats Where to keep the rows and columns of a RESERVE.
+/// @param max_seats Number of seats there is room for.
+/// @return 0 if the operation was decoded, 1 if it is invalid.
+static int decode_v2_operation(char op_code, const char** cursor, const char* end, struct BatchOperation* op,
+                               size_t* seats, size_t max_seats) {
+  uint64_t event_id, value;
+  if (get_number(cursor, end, UINT_MAX, &event_id) != 0) return 1;
+  op->op_code = op_code;
+  op->event_id = (unsigned int)event_id;
+
+  if (op_code == '3') {
+    if (get_number(cursor, end, SIZE_MAX, &value) != 0) return 1;
+    op->num_rows = (size_t)value;
+    if (get_number(cursor, end, SIZE_MAX, &value) != 0) return 1;
+    op->num_cols = (size_t)value;
+    return 0;
+  }
+  if (op_code != '4' || get_number(cursor, end, MAX_RESERVATION_SIZE, &value) != 0 || value > max_seats) return 1;
+
+  op->num_seats = (size_t)value;
+  op->xs = seats;
+  op->ys = seats + op->num_seats;
+  for (size_t i = 0; i < op->num_seats; i++) {
+    if (get_number(cursor, end, SIZE_MAX, &value) != 0) return 1;
+    op->xs[i] = (size_t)value;
+    if (get_number(cursor, end, SIZE_MAX, &value) != 0) return 1;
+    op->ys[i] = (size_t)value;
+  }
+  return 0;
+}
+
+/// Decodes a frame, whose header was already checked by request_size.
+/// @return 0 if the request was decoded and took up the whole payload, 1 if it is invalid.
+static int decode_v2(const char* data, struct Request* request) {
+  const char* cursor = data + 1;
+  uint64_t payload_size, num_ops;
+  if (varint_get(&cursor, cursor + VARINT_MAX_SIZE, &payload_size) != 0) return 1;
+  const char* end = cursor + payload_size;
+
+  if (cursor == end) return 1;
+  request->op_code = *cursor++;
+  request->num_ops = 0;
+  if (varint_get(&cursor, end, &request->client_id) != 0) return 1;
+
+  switch (request->op_code) {
+    case '3':
+    case '4':
+      request->num_ops = 1;
+      if (decode_v2_operation(request->op_code, &cursor, end, &request->ops[0], request->seats, MAX_BATCH_SEATS) != 0)
+        return 1;
+      break;
+
+    case '5': {
+      uint64_t event_id;
+      if (get_number(&cursor, end, UINT_MAX, &event_id) != 0) return 1;
+      request->event_id = (unsigned int)event_id;
+      break;
+    }
+
+    case '8': {
+      if (get_number(&cursor, end, MAX_BATCH_OPERATIONS, &num_ops) != 0 || num_ops == 0) return 1;
+      size_t used = 0;
+      for (request->num_ops = 0; request->num_ops < num_ops; request->num_ops++) {
+        if (cursor == end) return 1;
+        struct BatchOperation* op = &request->ops[request->num_ops];
+        char op_code = *cursor++;
+        if (decode_v2_operation(op_code, &cursor, end, op, request->seats + used, MAX_BATCH_SEATS - used / 2) != 0)
+          return 1;
+        used += 2 * (op_code == '4' ? op->num_seats : 0);
+      }
+      break;
+    }
+
+    default:
+      break;
+  }
+
+  // Bytes left over mean the frame does not hold what its op code says, so it is not guessed at.
+  return cursor != end;
+}
+
+int handle_request(const char* data, int session_id, int fd_resp, struct Ring* ring_resp) {
+  struct Request request;
+  if ((unsigned char)data[0] == FRAME_VERSION) {
+    if (decode_v2(data, &request) != 0) return 1;
+  } else {
+    decode_v1(data, &request);
+  }
+  if (request.client_id != (uint64_t)session_id) return 0;
+
+  struct BatchOperation* op = &request.ops[0];
+  int results[MAX_BATCH_OPERATIONS];
+  switch (request.op_code) {
+    case '2':
+      return 1;
+
+    case '3':
+      return respond_ret(ems_create(op->event_id, op->num_rows, op->num_cols), fd_resp, ring_resp);
+
+    case '4':
+      return respond_ret(ems_reserve(op->event_id, op->num_seats, op->xs, op->ys), fd_resp, ring_resp);
+
+    case '5':
+      if (ring_resp != NULL) return ems_show_ring(ring_resp, fd_resp, request.event_id);
+      return ems_show(fd_resp, request.event_id);
+
+    case '6':
+      if (ring_resp != NULL) return ems_list_events_ring(ring_resp, fd_resp);
+      return ems_list_events(fd_resp);
+
+    case '7':
+      // Only sessions on the socket can move to shared memory, and only the socket transport handles that.
+      return respond_ret(1, fd_resp, ring_resp);
+
+    case '8':
+      ems_batch(request.ops, request.num_ops);
+      for (size_t i = 0; i < request.num_ops; i++) {
+        results[i] = request.ops[i].result;
+      }
+      return respond(results, sizeof(int) * request.num_ops, fd_resp, ring_resp);
+
+    default:
+      return 1;
+  }
+}
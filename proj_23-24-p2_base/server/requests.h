@@ -0,0 +1,40 @@
+#ifndef SERVER_REQUESTS_H
+#define SERVER_REQUESTS_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "common/constants.h"
+#include "common/frame.h"
+#include "common/ring.h"
+
+// Every request of version 1 starts with its op code and the id of the session it belongs to. Version 2 wraps the
+// same fields in frames, see common/frame.h.
+#define REQUEST_HEADER_SIZE (sizeof(char) + sizeof(int))
+
+// A RESERVE of as many seats as allowed, the largest request of version 1.
+#define MAX_V1_REQUEST_SIZE \
+  (REQUEST_HEADER_SIZE + sizeof(unsigned int) + sizeof(size_t) + sizeof(size_t) * 2 * MAX_RESERVATION_SIZE)
+
+// The largest request of either version.
+#define MAX_REQUEST_SIZE (MAX_FRAME_SIZE > MAX_V1_REQUEST_SIZE ? MAX_FRAME_SIZE : MAX_V1_REQUEST_SIZE)
+
+/// Works out the size of the request at the start of a buffer, which may only hold part of it.
+/// @note Calling it again once that many bytes are in may give a larger size, as the size of a RESERVE is only
+/// known after its number of seats.
+/// @param data Bytes of the request received so far.
+/// @param len Number of bytes received so far.
+/// @return Number of bytes needed to go on, -1 if the request is invalid.
+ssize_t request_size(const char* data, size_t len);
+
+/// Runs a whole request of a session and writes its response.
+/// @note Requests carrying the id of another session are ignored, without a response.
+/// @param request The request, of the size given by request_size.
+/// @param session_id Id of the session the request was received on.
+/// @param fd_resp File descriptor to write the response to. With a ring, socket to the client, which ends the wait
+/// for room in the ring if it hangs up.
+/// @param ring_resp Response ring of a shared-memory session, NULL to write the response to fd_resp.
+/// @return 0 if the session goes on, 1 if the client quit or went away.
+int handle_request(const char* request, int session_id, int fd_resp, struct Ring* ring_resp);
+
+#endif  // SERVER_REQUESTS_H
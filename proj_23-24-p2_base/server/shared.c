@@ -0,0 +1,111 @@
+#define _GNU_SOURCE  // File seals are not part of POSIX.1-2008
+#include "shared.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "common/constants.h"
+#include "common/ring.h"
+#include "requests.h"
+
+struct SharedSessionThread {
+  int socket_fd;
+  int id;
+  struct SharedSession* shared;
+};
+
+// Seals the region must carry, so the client cannot resize it under the server's mapping.
+#define REQUIRED_SEALS (F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL)
+
+static atomic_int num_sessions = 0;  // Shared-memory sessions being served, each by a thread of its own.
+
+/// Runs the requests of a shared-memory session until the client quits or goes away.
+static void* serve_shared_session(void* arg) {
+  struct SharedSessionThread* session = (struct SharedSessionThread*)arg;
+  struct SharedSession* shared = session->shared;
+
+  int ret = 0;
+  if (write(session->socket_fd, &ret, sizeof(int)) == sizeof(int)) {
+    // Each request is read in as many steps as it takes to learn its size.
+    while (1) {
+      char request[MAX_REQUEST_SIZE];
+      size_t len = 0;
+      ssize_t size;
+      while ((size = request_size(request, len)) > (ssize_t)len) {
+        if (ring_read(&shared->requests, request + len, (size_t)size - len, session->socket_fd) != 0) {
+          size = -1;
+          break;
+        }
+        len = (size_t)size;
+      }
+
+      if (size < 0 || handle_request(request, session->id, session->socket_fd, &shared->responses) != 0) break;
+    }
+  }
+
+  munmap(shared, sizeof(struct SharedSession));
+  close(session->socket_fd);
+  free(session);
+  atomic_fetch_sub(&num_sessions, 1);
+  return NULL;
+}
+
+int shared_session_start(int socket_fd, int shm_fd, int session_id) {
+  // A region that could still shrink would have the session thread fault on reading it.
+  int seals = fcntl(shm_fd, F_GET_SEALS);
+  if (seals < 0 || (seals & REQUIRED_SEALS) != REQUIRED_SEALS) {
+    fprintf(stderr, "Shared memory of session %d is not sealed\n", session_id);
+    close(shm_fd);
+    return 1;
+  }
+
+  struct stat shm_stat;
+  if (fstat(shm_fd, &shm_stat) != 0 || (size_t)shm_stat.st_size < sizeof(struct SharedSession)) {
+    fprintf(stderr, "Shared memory of session %d is too small\n", session_id);
+    close(shm_fd);
+    return 1;
+  }
+
+  struct SharedSession* shared =
+      mmap(NULL, sizeof(struct SharedSession), PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+  close(shm_fd);
+  if (shared == MAP_FAILED) {
+    fprintf(stderr, "Error mapping shared memory of session %d\n", session_id);
+    return 1;
+  }
+
+  if (atomic_fetch_add(&num_sessions, 1) >= MAX_SHARED_SESSION_COUNT) {
+    fprintf(stderr, "Too many shared-memory sessions\n");
+    atomic_fetch_sub(&num_sessions, 1);
+    munmap(shared, sizeof(struct SharedSession));
+    return 1;
+  }
+
+  struct SharedSessionThread* session = malloc(sizeof(struct SharedSessionThread));
+  pthread_t thread;
+  if (session == NULL) {
+    fprintf(stderr, "Error allocating memory for session\n");
+    atomic_fetch_sub(&num_sessions, 1);
+    munmap(shared, sizeof(struct SharedSession));
+    return 1;
+  }
+  session->socket_fd = socket_fd;
+  session->id = session_id;
+  session->shared = shared;
+
+  if (pthread_create(&thread, NULL, serve_shared_session, session) != 0) {
+    fprintf(stderr, "Error creating thread\n");
+    atomic_fetch_sub(&num_sessions, 1);
+    munmap(shared, sizeof(struct SharedSession));
+    free(session);
+    return 1;
+  }
+  pthread_detach(thread);
+  return 0;
+}
@@ -0,0 +1,16 @@
+#ifndef SERVER_SHARED_H
+#define SERVER_SHARED_H
+
+/// Moves a socket session to the rings of a shared-memory region the client sent over the socket.
+/// @note Each such session gets its own thread, as sleeping on a futex does not mix with epoll, so at most
+/// MAX_SHARED_SESSION_COUNT are served at once. Its requests are busy-polled for a while before it sleeps, so
+/// co-located clients get round trips without syscalls.
+/// @param socket_fd Socket of the session, kept to notice the client going away and closed when the session ends.
+/// @param shm_fd Shared-memory region holding a struct SharedSession, sealed against shrinking and growing. Closed
+/// once mapped.
+/// @param session_id Id of the session.
+/// @return 0 if the session moved, after which socket_fd belongs to its thread, which confirms the move to the
+/// client; 1 otherwise.
+int shared_session_start(int socket_fd, int shm_fd, int session_id);
+
+#endif  // SERVER_SHARED_H
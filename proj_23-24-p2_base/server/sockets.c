@@ -0,0 +1,285 @@
+#include "sockets.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "requests.h"
+#include "shared.h"
+
+#define SEND_TIMEOUT_MS 1000   // Longest a worker waits for a client to make room for a response.
+#define ACCEPT_BACKOFF_MS 10   // Pause before watching for clients again when no file descriptor is left for them.
+
+// A client connected to the socket. Only the worker that got its epoll event touches it until the event is rearmed.
+struct SocketSession {
+  int fd;
+  int id;
+  int shm_fd;  // Shared memory the client sent for the session to move to, -1 if none.
+  size_t len;  // Bytes of unhandled requests received so far.
+  char data[MAX_REQUEST_SIZE];
+};
+
+static int epoll_fd = -1;
+static int listen_fd = -1;
+static int spare_fd = -1;  // Given up to turn a client away when no other file descriptor is left.
+static atomic_uint sessions_started = 0;
+
+/// Watches a file descriptor for the next time it can be read, by a single worker.
+/// @param op EPOLL_CTL_ADD for a new file descriptor, EPOLL_CTL_MOD to rearm one.
+/// @param fd File descriptor to watch.
+/// @param session Session of the file descriptor, NULL for the listening socket.
+/// @return 0 if the file descriptor is watched, 1 otherwise.
+static int watch(int op, int fd, struct SocketSession* session) {
+  struct epoll_event event;
+  memset(&event, 0, sizeof(event));
+  event.events = EPOLLIN | EPOLLONESHOT;
+  event.data.ptr = session;
+  return epoll_ctl(epoll_fd, op, fd, &event) != 0;
+}
+
+/// Ends a session, closing its socket.
+static void close_session(struct SocketSession* session) {
+  epoll_ctl(epoll_fd, EPOLL_CTL_DEL, session->fd, NULL);
+  close(session->fd);
+  if (session->shm_fd >= 0) close(session->shm_fd);
+  free(session);
+}
+
+/// Turns the next waiting client away when no file descriptor is left to accept it with, using the spare one.
+/// @note A client left waiting keeps the listening socket readable, so workers would spin on it.
+/// @return 0 if a client was turned away, 1 otherwise.
+static int refuse_session() {
+  if (spare_fd < 0) return 1;
+  close(spare_fd);
+  int fd = accept(listen_fd, NULL, NULL);
+  if (fd >= 0) close(fd);
+  spare_fd = open("/dev/null", O_RDONLY);
+  return fd < 0;
+}
+
+/// Gets the id of a new socket session.
+/// @note Ids below MAX_SESSION_COUNT are those of the pipe sessions. Past INT_MAX they start over, as ids only tell a
+/// session's own requests apart from those of others and no more than a few sessions are open at a time.
+/// @return Id of the session.
+static int next_session_id() {
+  unsigned int num_ids = (unsigned int)INT_MAX - MAX_SESSION_COUNT + 1;
+  return MAX_SESSION_COUNT + (int)(atomic_fetch_add(&sessions_started, 1) % num_ids);
+}
+
+/// Accepts every client waiting on the listening socket and sends each its session id.
+static void accept_sessions() {
+  // Responses are written whole, so a client that stops reading only holds a worker up to the timeout.
+  struct timeval timeout = {SEND_TIMEOUT_MS / 1000, (SEND_TIMEOUT_MS % 1000) * 1000};
+  int fd;
+  while ((fd = accept(listen_fd, NULL, NULL)) >= 0 || errno == EINTR || errno == ECONNABORTED ||
+         ((errno == EMFILE || errno == ENFILE) && refuse_session() == 0)) {
+    if (fd < 0) continue;
+    if (setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout)) != 0) {
+      fprintf(stderr, "Error starting session\n");
+      close(fd);
+      continue;
+    }
+
+    struct SocketSession* session = malloc(sizeof(struct SocketSession));
+    if (session == NULL) {
+      fprintf(stderr, "Error allocating memory for session\n");
+      close(fd);
+      continue;
+    }
+    session->fd = fd;
+    session->id = next_session_id();
+    session->shm_fd = -1;
+    session->len = 0;
+
+    if (write(fd, &session->id, sizeof(int)) != sizeof(int) || watch(EPOLL_CTL_ADD, fd, session) != 0) {
+      fprintf(stderr, "Error starting session\n");
+      close(fd);
+      free(session);
+    }
+  }
+
+  if (errno != EAGAIN && errno != EWOULDBLOCK) {
+    fprintf(stderr, "Error accepting client: %s\n", strerror(errno));
+    struct timespec backoff = {0, ACCEPT_BACKOFF_MS * 1000000L};
+    nanosleep(&backoff, NULL);
+  }
+  if (watch(EPOLL_CTL_MOD, listen_fd, NULL) != 0) fprintf(stderr, "Error watching socket, no more clients\n");
+}
+
+/// Receives bytes of requests, and the file descriptor sent with them if any.
+/// @return Number of bytes received, 0 if the client closed the socket, -1 on failure or if none are there.
+static ssize_t receive(struct SocketSession* session) {
+  struct iovec iov = {.iov_base = session->data + session->len, .iov_len = MAX_REQUEST_SIZE - session->len};
+  union {
+    char buf[CMSG_SPACE(sizeof(int))];
+    struct cmsghdr align;
+  } control;
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+
+  ssize_t bytes;
+  do {
+    bytes = recvmsg(session->fd, &msg, MSG_DONTWAIT);
+  } while (bytes == -1 && errno == EINTR);
+
+  struct cmsghdr* cmsg = bytes > 0 ? CMSG_FIRSTHDR(&msg) : NULL;
+  if (cmsg != NULL && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+    if (session->shm_fd >= 0) close(session->shm_fd);
+    memcpy(&session->shm_fd, CMSG_DATA(cmsg), sizeof(int));
+  }
+  return bytes;
+}
+
+/// Moves a session to shared memory, as asked for by its client with a request in its buffer.
+/// @param start Offset of the request in the buffer, whose earlier requests have all been run.
+/// @return 0 if the caller is done with the session, having moved, been closed or gone back to epoll, 1 if the
+/// caller goes on serving it from the request that follows.
+static int move_to_shared_memory(struct SocketSession* session, size_t start) {
+  int client_id;
+  memcpy(&client_id, session->data + start + sizeof(char), sizeof(int));
+
+  // The client waits for the answer, so a session with requests after this one is not moved, and they are run as
+  // usual. The socket leaves epoll before the session thread can close it.
+  int removed = client_id == session->id && session->shm_fd >= 0 && session->len == start + REQUEST_HEADER_SIZE &&
+                epoll_ctl(epoll_fd, EPOLL_CTL_DEL, session->fd, NULL) == 0;
+  if (removed) {
+    int shm_fd = session->shm_fd;
+    session->shm_fd = -1;
+    if (shared_session_start(session->fd, shm_fd, session->id) == 0) {
+      free(session);
+      return 0;
+    }
+    session->len = 0;
+  }
+
+  int ret = 1;
+  if (write(session->fd, &ret, sizeof(int)) != sizeof(int)) {
+    close_session(session);
+    return 0;
+  }
+  if (!removed) return 1;
+
+  // Back in epoll only once done with, as any worker may serve the session from then on.
+  if (watch(EPOLL_CTL_ADD, session->fd, session) != 0) close_session(session);
+  return 0;
+}
+
+/// Runs the requests of a session received in full, keeping the start of the next one for later.
+/// @note Reads once and goes back to epoll, so a busy client cannot hold up the others for long.
+static void serve_session(struct SocketSession* session) {
+  // The socket is blocking, so responses are written whole unless the client stops reading them, but reading must
+  // not wait for more requests.
+  ssize_t bytes = receive(session);
+  if (bytes == 0 || (bytes == -1 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+    close_session(session);
+    return;
+  }
+  session->len += bytes > 0 ? (size_t)bytes : 0;
+
+  size_t start = 0;
+  ssize_t size;
+  while ((size = request_size(session->data + start, session->len - start)) > 0 &&
+         (size_t)size <= session->len - start) {
+    if (session->data[start] == '7') {
+      if (move_to_shared_memory(session, start) == 0) return;
+      start += (size_t)size;
+      continue;
+    }
+    if (handle_request(session->data + start, session->id, session->fd, NULL) != 0) {
+      close_session(session);
+      return;
+    }
+    start += (size_t)size;
+  }
+
+  if (size < 0) {
+    fprintf(stderr, "Invalid request, closing session %d\n", session->id);
+    close_session(session);
+    return;
+  }
+
+  memmove(session->data, session->data + start, session->len - start);
+  session->len -= start;
+  if (watch(EPOLL_CTL_MOD, session->fd, session) != 0) {
+    fprintf(stderr, "Error watching session %d\n", session->id);
+    close_session(session);
+  }
+}
+
+/// Runs the requests of whichever sessions have some, forever.
+static void* socket_worker(void* arg) {
+  (void)arg;
+  while (1) {
+    struct epoll_event event;
+    if (epoll_wait(epoll_fd, &event, 1, -1) != 1) continue;
+
+    if (event.data.ptr == NULL)
+      accept_sessions();
+    else
+      serve_session(event.data.ptr);
+  }
+  return NULL;
+}
+
+int sockets_start(const char* path, unsigned int num_workers) {
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(address.sun_path)) {
+    fprintf(stderr, "Socket path too long\n");
+    return 1;
+  }
+  strcpy(address.sun_path, path);
+
+  unlink(path);
+  listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listen_fd < 0 || bind(listen_fd, (struct sockaddr*)&address, sizeof(address)) != 0 ||
+      listen(listen_fd, SOMAXCONN) != 0 || fcntl(listen_fd, F_SETFL, O_NONBLOCK) != 0) {
+    fprintf(stderr, "Error creating socket: %s\n", strerror(errno));
+    return 1;
+  }
+
+  spare_fd = open("/dev/null", O_RDONLY);
+  epoll_fd = epoll_create1(0);
+  if (epoll_fd < 0 || watch(EPOLL_CTL_ADD, listen_fd, NULL) != 0) {
+    fprintf(stderr, "Error creating epoll instance\n");
+    return 1;
+  }
+
+  // Signals are left to the main thread, which is the one serving them for the pipe transport too.
+  sigset_t mask, old_mask;
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGUSR1);
+  sigaddset(&mask, SIGUSR2);
+  pthread_sigmask(SIG_BLOCK, &mask, &old_mask);
+
+  int result = 0;
+  for (unsigned int i = 0; i < num_workers && result == 0; i++) {
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, socket_worker, NULL) != 0) {
+      fprintf(stderr, "Error creating thread\n");
+      result = 1;
+    } else {
+      pthread_detach(thread);
+    }
+  }
+
+  pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+  return result;
+}
@@ -0,0 +1,12 @@
+#ifndef SERVER_SOCKETS_H
+#define SERVER_SOCKETS_H
+
+/// Starts serving sessions over a Unix stream socket, next to the named pipe.
+/// @note Sessions are not tied to threads: a pool of workers waits on one epoll instance and runs the requests of
+/// whichever sessions have some, so idle clients cost a file descriptor and a buffer each.
+/// @param path Path to bind the socket to, replacing whatever is there.
+/// @param num_workers Number of threads running requests.
+/// @return 0 if the socket is being served, 1 otherwise.
+int sockets_start(const char* path, unsigned int num_workers);
+
+#endif  // SERVER_SOCKETS_H
@@ -0,0 +1,354 @@
+#include "wal.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "common/constants.h"
+
+#define WAL_HEADER_SIZE 8          // Payload length and checksum, 32 bits each.
+#define WAL_ASYNC_INTERVAL_MS 10  // Time between background flushes in async mode.
+
+// Group commit log. Appenders fill buffer; whoever commits first writes and syncs every record
+// appended so far, while later committers wait on flushed for that batch.
+static struct {
+  int fd;
+  int async;
+  pthread_mutex_t mutex;
+  pthread_cond_t flushed;    // Signaled whenever durable_lsn advances or a flush fails.
+  char* buffer;              // Records not handed to a flush yet.
+  size_t length, capacity;   // Bytes used and allocated in buffer.
+  unsigned long next_lsn;    // Sequence number of the last appended record.
+  unsigned long durable_lsn;  // Every record up to this one has been written and synced.
+  size_t end;                // Log offset just past the last appended record.
+  int flushing;              // Whether a flush is in progress.
+  pthread_t flusher;         // Background flusher, async mode only.
+} wal = {.fd = -1, .mutex = PTHREAD_MUTEX_INITIALIZER, .flushed = PTHREAD_COND_INITIALIZER};
+
+/// Computes the FNV-1a checksum of a record payload.
+static uint32_t checksum(const unsigned char* data, size_t length) {
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < length; i++) {
+    hash = (hash ^ data[i]) * 16777619u;
+  }
+  return hash;
+}
+
+static void put_u32(unsigned char** cursor, uint32_t value) {
+  memcpy(*cursor, &value, sizeof(uint32_t));
+  *cursor += sizeof(uint32_t);
+}
+
+static void put_u64(unsigned char** cursor, uint64_t value) {
+  memcpy(*cursor, &value, sizeof(uint64_t));
+  *cursor += sizeof(uint64_t);
+}
+
+static uint32_t get_u32(const unsigned char** cursor) {
+  uint32_t value;
+  memcpy(&value, *cursor, sizeof(uint32_t));
+  *cursor += sizeof(uint32_t);
+  return value;
+}
+
+static uint64_t get_u64(const unsigned char** cursor) {
+  uint64_t value;
+  memcpy(&value, *cursor, sizeof(uint64_t));
+  *cursor += sizeof(uint64_t);
+  return value;
+}
+
+/// Writes a whole buffer, retrying on short writes.
+/// @return 0 if the buffer was written successfully, 1 otherwise.
+static int write_all(int fd, const char* data, size_t length) {
+  while (length > 0) {
+    ssize_t written = write(fd, data, length);
+    if (written == -1) {
+      if (errno == EINTR) continue;
+      return 1;
+    }
+    data += written;
+    length -= (size_t)written;
+  }
+  return 0;
+}
+
+/// Stops the server once the log cannot take any more records.
+/// @note Must be called with the mutex held, so only the first failure is reported. A failed fsync may have dropped
+/// the pages it did not write, so neither retrying nor going on without them leaves a log that replays to what clients
+/// were told. Restarting replays what is durable.
+static _Noreturn void fail_log(const char* message) {
+  fprintf(stderr, "%s, stopping the server\n", message);
+  exit(EXIT_FAILURE);
+}
+
+/// Writes and syncs every buffered record.
+/// @note Must be called with the mutex held and no flush in progress. The mutex is released during I/O.
+static void flush_locked() {
+  char* batch = wal.buffer;
+  size_t length = wal.length;
+  unsigned long batch_lsn = wal.next_lsn;
+  if (length == 0) return;
+
+  // Appenders keep going into a fresh buffer while this batch is written.
+  wal.buffer = NULL;
+  wal.length = 0;
+  wal.capacity = 0;
+  wal.flushing = 1;
+  pthread_mutex_unlock(&wal.mutex);
+
+  // Only flushes write to the log, so it ends where this batch starts.
+  off_t start = lseek(wal.fd, 0, SEEK_END);
+  int failed = start == -1 || write_all(wal.fd, batch, length) != 0 || fdatasync(wal.fd) != 0;
+  free(batch);
+
+  pthread_mutex_lock(&wal.mutex);
+  if (failed) {
+    // Requests of the batch are not answered in sync mode, so none may be replayed from whatever part was written.
+    if (start != -1 && ftruncate(wal.fd, start) == -1) fprintf(stderr, "Error truncating log\n");
+    fail_log("Error writing to log");
+  }
+  wal.flushing = 0;
+  wal.durable_lsn = batch_lsn;
+  pthread_cond_broadcast(&wal.flushed);
+}
+
+/// Periodically flushes the log in async mode.
+static void* flush_periodically(void* arg) {
+  (void)arg;
+
+  // Signals are for the main thread, which watches for them between client connections.
+  sigset_t mask;
+  sigfillset(&mask);
+  pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+  struct timespec interval = {0, WAL_ASYNC_INTERVAL_MS * 1000000L};
+
+  while (1) {
+    nanosleep(&interval, NULL);
+    pthread_mutex_lock(&wal.mutex);
+    if (!wal.flushing) {
+      flush_locked();
+    }
+    pthread_mutex_unlock(&wal.mutex);
+  }
+  return NULL;
+}
+
+/// Appends an encoded record to the buffer.
+/// @return Sequence number of the record, 0 if the log is closed.
+static unsigned long append_record(const unsigned char* payload, size_t payload_length) {
+  pthread_mutex_lock(&wal.mutex);
+  if (wal.fd == -1) {
+    pthread_mutex_unlock(&wal.mutex);
+    return 0;
+  }
+
+  size_t needed = wal.length + WAL_HEADER_SIZE + payload_length;
+  if (needed > wal.capacity) {
+    size_t capacity = wal.capacity ? wal.capacity : 4096;
+    while (capacity < needed) capacity *= 2;
+    char* buffer = realloc(wal.buffer, capacity);
+    // Records already buffered may belong to the same request as this one, so they cannot be written without it.
+    if (!buffer) fail_log("Error allocating memory for log");
+    wal.buffer = buffer;
+    wal.capacity = capacity;
+  }
+
+  unsigned char* cursor = (unsigned char*)wal.buffer + wal.length;
+  put_u32(&cursor, (uint32_t)payload_length);
+  put_u32(&cursor, checksum(payload, payload_length));
+  memcpy(cursor, payload, payload_length);
+  wal.length = needed;
+
+  wal.end += WAL_HEADER_SIZE + payload_length;
+  unsigned long lsn = ++wal.next_lsn;
+  pthread_mutex_unlock(&wal.mutex);
+  return lsn;
+}
+
+unsigned long wal_log_create(unsigned int event_id, size_t num_rows, size_t num_cols) {
+  unsigned char payload[1 + sizeof(uint32_t) + sizeof(uint64_t) * 2];
+  unsigned char* cursor = payload;
+  *cursor++ = 'C';
+  put_u32(&cursor, event_id);
+  put_u64(&cursor, num_rows);
+  put_u64(&cursor, num_cols);
+  return append_record(payload, sizeof(payload));
+}
+
+unsigned long wal_log_reserve(unsigned int event_id, unsigned int reservation_id, size_t num_seats, const size_t* xs,
+                              const size_t* ys) {
+  unsigned char payload[1 + sizeof(uint32_t) * 3 + sizeof(uint64_t) * 2 * MAX_RESERVATION_SIZE];
+
+  // Seats are 64-bit like the dimensions, as sparse events have rows and columns past 32 bits.
+  unsigned char* cursor = payload;
+  *cursor++ = 'S';
+  put_u32(&cursor, event_id);
+  put_u32(&cursor, reservation_id);
+  put_u32(&cursor, (uint32_t)num_seats);
+  for (size_t i = 0; i < num_seats; i++) {
+    put_u64(&cursor, xs[i]);
+    put_u64(&cursor, ys[i]);
+  }
+  return append_record(payload, (size_t)(cursor - payload));
+}
+
+/// Waits until a record is durable, flushing the buffer if no one else is.
+/// @note Must be called with the mutex held.
+static void wait_durable(unsigned long lsn) {
+  while (wal.durable_lsn < lsn) {
+    if (wal.flushing) {
+      pthread_cond_wait(&wal.flushed, &wal.mutex);
+    } else {
+      // Become the leader: this flush also covers everything appended by the waiting followers.
+      flush_locked();
+    }
+  }
+}
+
+void wal_commit(unsigned long lsn) {
+  if (lsn == 0 || wal.async) return;
+
+  pthread_mutex_lock(&wal.mutex);
+  wait_durable(lsn);
+  pthread_mutex_unlock(&wal.mutex);
+}
+
+void wal_flush() {
+  pthread_mutex_lock(&wal.mutex);
+  wait_durable(wal.next_lsn);
+  pthread_mutex_unlock(&wal.mutex);
+}
+
+size_t wal_end() {
+  pthread_mutex_lock(&wal.mutex);
+  size_t end = wal.end;
+  pthread_mutex_unlock(&wal.mutex);
+  return end;
+}
+
+int wal_open(const char* path, int async) {
+  int fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0666);
+  if (fd == -1) {
+    fprintf(stderr, "Error opening log\n");
+    return 1;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    fprintf(stderr, "Error opening log\n");
+    close(fd);
+    return 1;
+  }
+
+  pthread_mutex_lock(&wal.mutex);
+  wal.fd = fd;
+  wal.end = (size_t)st.st_size;
+  wal.async = async;
+  pthread_mutex_unlock(&wal.mutex);
+
+  if (async && pthread_create(&wal.flusher, NULL, flush_periodically, NULL) != 0) {
+    fprintf(stderr, "Error creating log flusher thread\n");
+    return 1;
+  }
+  return 0;
+}
+
+/// Applies one record payload.
+/// @return 0 if the record was applied successfully, 1 otherwise.
+static int apply_record(const unsigned char* payload, size_t length, const struct WalHandlers* handlers) {
+  const unsigned char* cursor = payload + 1;
+
+  if (payload[0] == 'C' && length == 1 + sizeof(uint32_t) + sizeof(uint64_t) * 2) {
+    unsigned int event_id = get_u32(&cursor);
+    size_t num_rows = (size_t)get_u64(&cursor);
+    size_t num_cols = (size_t)get_u64(&cursor);
+    return handlers->create(event_id, num_rows, num_cols);
+  }
+
+  // 'R' records, with 32-bit seats, are only written by older servers and still replayed.
+  if ((payload[0] == 'S' || payload[0] == 'R') && length >= 1 + sizeof(uint32_t) * 3) {
+    size_t seat_size = payload[0] == 'S' ? sizeof(uint64_t) : sizeof(uint32_t);
+    unsigned int event_id = get_u32(&cursor);
+    unsigned int reservation_id = get_u32(&cursor);
+    size_t num_seats = get_u32(&cursor);
+    if (num_seats > MAX_RESERVATION_SIZE || length != 1 + sizeof(uint32_t) * 3 + seat_size * 2 * num_seats) return 1;
+
+    size_t xs[MAX_RESERVATION_SIZE], ys[MAX_RESERVATION_SIZE];
+    for (size_t i = 0; i < num_seats; i++) {
+      xs[i] = seat_size == sizeof(uint64_t) ? (size_t)get_u64(&cursor) : get_u32(&cursor);
+      ys[i] = seat_size == sizeof(uint64_t) ? (size_t)get_u64(&cursor) : get_u32(&cursor);
+    }
+    return handlers->reserve(event_id, reservation_id, num_seats, xs, ys);
+  }
+
+  return 1;
+}
+
+int wal_replay(const char* path, size_t start, const struct WalHandlers* handlers) {
+  int fd = open(path, O_RDWR);
+  if (fd == -1) {
+    return errno == ENOENT ? 0 : 1;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    close(fd);
+    return 1;
+  }
+
+  size_t size = (size_t)st.st_size;
+  unsigned char* log = malloc(size ? size : 1);
+  if (!log) {
+    close(fd);
+    return 1;
+  }
+
+  size_t loaded = 0;
+  while (loaded < size) {
+    ssize_t bytes = read(fd, log + loaded, size - loaded);
+    if (bytes <= 0) break;
+    loaded += (size_t)bytes;
+  }
+
+  if (start > loaded) {
+    fprintf(stderr, "Log is shorter than the checkpoint, ignoring it\n");
+    free(log);
+    close(fd);
+    return 0;
+  }
+
+  size_t offset = start, records = 0;
+  while (offset + WAL_HEADER_SIZE <= loaded) {
+    const unsigned char* cursor = log + offset;
+    size_t length = get_u32(&cursor);
+    uint32_t sum = get_u32(&cursor);
+    if (length == 0 || length > loaded - offset - WAL_HEADER_SIZE || checksum(cursor, length) != sum) {
+      break;
+    }
+
+    if (apply_record(cursor, length, handlers) != 0) {
+      fprintf(stderr, "Error replaying log record %zu\n", records + 1);
+    }
+    offset += WAL_HEADER_SIZE + length;
+    records++;
+  }
+
+  // Whatever follows the last valid record was torn by a crash; new records go after the valid ones.
+  if (offset < size && ftruncate(fd, (off_t)offset) == -1) {
+    fprintf(stderr, "Error truncating log\n");
+  }
+
+  free(log);
+  close(fd);
+  return 0;
+}
@@ -0,0 +1,50 @@
+#ifndef SERVER_WAL_H
+#define SERVER_WAL_H
+
+#include <stddef.h>
+
+/// Callbacks used by wal_replay to rebuild the state, returning 0 on success.
+struct WalHandlers {
+  int (*create)(unsigned int event_id, size_t num_rows, size_t num_cols);
+  int (*reserve)(unsigned int event_id, unsigned int reservation_id, size_t num_seats, size_t* xs, size_t* ys);
+};
+
+/// Replays the records of a log, then truncates any torn record left at its end by a crash.
+/// @param path Path to the log. A missing log replays nothing.
+/// @param start Offset of the first record to replay, as returned by wal_end.
+/// @param handlers Callbacks applying each record.
+/// @return 0 if the log was replayed successfully, 1 otherwise.
+int wal_replay(const char* path, size_t start, const struct WalHandlers* handlers);
+
+/// Opens the log for appending. Until then, records are not logged.
+/// @param path Path to the log, created if missing.
+/// @param async 0 to make wal_commit wait for fsync, 1 to flush in the background.
+/// @return 0 if the log was opened successfully, 1 otherwise.
+int wal_open(const char* path, int async);
+
+/// Appends a CREATE record to the in-memory log buffer.
+/// @note Records of the same event must be appended in the order they were applied. Running out of memory for the
+/// buffer, like failing to write the log, stops the server, so a record is never lost while the log is open.
+/// @return Sequence number to pass to wal_commit, 0 if the log is closed.
+unsigned long wal_log_create(unsigned int event_id, size_t num_rows, size_t num_cols);
+
+/// Appends a RESERVE record to the in-memory log buffer, like wal_log_create.
+/// @param num_seats Number of seats, at most MAX_RESERVATION_SIZE.
+/// @return Sequence number to pass to wal_commit, 0 if the log is closed.
+unsigned long wal_log_reserve(unsigned int event_id, unsigned int reservation_id, size_t num_seats, const size_t* xs,
+                              const size_t* ys);
+
+/// Waits until a record is durable. Concurrent callers share one write and fsync (group commit).
+/// @note Returns immediately in async mode, or for sequence number 0, which stands for no record. If the log cannot
+/// be written, the server stops instead of returning, as the log would no longer replay to the state it serves.
+/// @param lsn Sequence number returned when the record was appended.
+void wal_commit(unsigned long lsn);
+
+/// Gets the offset just past the last appended record, where replaying would have to resume.
+/// @return Offset in the log, 0 if the log is closed.
+size_t wal_end();
+
+/// Writes and syncs every record appended so far, even in async mode. Stops the server like wal_commit on failure.
+void wal_flush();
+
+#endif  // SERVER_WAL_H